@@ -31,6 +31,20 @@ QMAKE_CXXFLAGS += -isystem "$$[QT_INSTALL_HEADERS]/qt5" -isystem "$$[QT_INSTALL_
                   -isystem "$$[QT_INSTALL_HEADERS]/QtXml" -isystem "/usr/include/qt5/QtGui" \
                   -isystem "$$[QT_INSTALL_HEADERS]/QtCore"
 
+# Wrap every file list into a raw string literal, which core/filelists.cpp parses at compile time.
+# Its line count goes first, so the parser knows how big a table to parse it into. Every list item
+# is written on its own line, so this gives "N," then uR"fsmtcsv( then the CSV then )fsmtcsv".
+# The CSVs are tracked like included project files, so changing one re-runs qmake.
+FILELISTS = kf1 kf2_cd kf2_gameexe kf2_op_e kf2_op_j kf2_op_u
+for(fileList, FILELISTS) {
+    fileListCsv = $$PWD/filelists/$${fileList}.csv
+    fileListLines = $$cat($$fileListCsv, lines)
+    fileListLiteral = "$$size(fileListLines)," "uR\"fsmtcsv(" $$fileListLines ")fsmtcsv\""
+    write_file($$OUT_PWD/filelist_$${fileList}.inc, fileListLiteral)|error()
+    QMAKE_INTERNAL_INCLUDED_FILES += $$fileListCsv
+}
+INCLUDEPATH += $$OUT_PWD
+
 HEADERS += \
     libimagequant/blur.h \
     libimagequant/kmeans.h \
@@ -41,11 +55,17 @@ HEADERS += \
     libimagequant/pam.h \
     libimagequant/remap.h \
     aboutdialog.h \
+    core/batchmode.h \
+    core/benchmarks.h \
+    core/binaryreader.h \
+    core/discimage.h \
+    core/filelists.h \
     core/icons.h \
     core/kfmtcore.h \
     core/kfmterror.h \
     core/kfmtfile.h \
     core/prettynames.h \
+    core/projectindex.h \
     datahandlers/gameexe.h \
     datahandlers/kfmtdatahandler.h \
     datahandlers/map.h \
@@ -117,11 +137,16 @@ SOURCES += \
     libimagequant/pam.c \
     libimagequant/remap.c \
     aboutdialog.cpp \
+    core/batchmode.cpp \
+    core/benchmarks.cpp \
+    core/discimage.cpp \
+    core/filelists.cpp \
     core/icons.cpp \
     core/kfmtcore.cpp \
     core/kfmterror.cpp \
     core/kfmtfile.cpp \
     core/prettynames.cpp \
+    core/projectindex.cpp \
     datahandlers/gameexe.cpp \
     datahandlers/map.cpp \
     datahandlers/model.cpp \
@@ -187,6 +212,12 @@ RESOURCES += \
 	resources.qrc
 
 DISTFILES += \
+    filelists/kf1.csv \
+    filelists/kf2_cd.csv \
+    filelists/kf2_gameexe.csv \
+    filelists/kf2_op_e.csv \
+    filelists/kf2_op_j.csv \
+    filelists/kf2_op_u.csv \
     litCommon.frag \
     litMime.vert \
     litStatic.vert \
@@ -0,0 +1,259 @@
+#include "batchmode.h"
+#include "core/benchmarks.h"
+#include "core/kfmtcore.h"
+#include "core/kfmterror.h"
+#include "datahandlers/model.h"
+#include "datahandlers/texturedb.h"
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+#include <QThreadPool>
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+
+namespace
+{
+const QString extractCommand = QStringLiteral("extract");
+const QString exportTexturesCommand = QStringLiteral("export-textures");
+const QString exportModelsCommand = QStringLiteral("export-models");
+const QString verifyCommand = QStringLiteral("verify");
+const QString benchmarkCommand = QStringLiteral("benchmark");
+
+/*!
+ * \brief Prints one line of machine-readable output.
+ */
+void report(const QString& command, const QString& phase, QJsonObject fields)
+{
+    fields.insert(QStringLiteral("version"), QStringLiteral(RUNID));
+    fields.insert(QStringLiteral("command"), command);
+    fields.insert(QStringLiteral("phase"), phase);
+    std::cout << QJsonDocument(fields).toJson(QJsonDocument::Compact).toStdString() << std::endl;
+}
+
+int runBenchmarks(size_t items, qint64 minTimeMs)
+{
+    if (items == 0 || minTimeMs <= 0)
+    {
+        std::cerr << "--items and --min-time need positive numbers.\n";
+        return 2;
+    }
+
+    for (const auto& result : Benchmarks::run(items, minTimeMs))
+    {
+        const auto seconds = static_cast<double>(result.nanoseconds) / 1e9;
+        const auto iterations = static_cast<double>(result.iterations);
+        report(benchmarkCommand,
+               QStringLiteral("benchmark"),
+               {{QStringLiteral("name"), result.name},
+                {QStringLiteral("unit"), result.unit},
+                {QStringLiteral("bytes"), static_cast<qint64>(result.bytes)},
+                {QStringLiteral("items"), static_cast<qint64>(result.items)},
+                {QStringLiteral("iterations"), static_cast<qint64>(result.iterations)},
+                {QStringLiteral("ms"), static_cast<double>(result.nanoseconds) / 1e6},
+                {QStringLiteral("MBps"), result.bytes * iterations / seconds / 1e6},
+                {QStringLiteral("itemsPerSecond"), result.items * iterations / seconds}});
+    }
+    return 0;
+}
+
+/*!
+ * \brief Collects every file in the tree, splitting every container on the way.
+ * Splitting happens here, on one thread, so jobs on the pool never split anything themselves.
+ */
+void collectFiles(KFMTFile& folder, std::vector<KFMTFile*>& files)
+{
+    const auto count = folder.childCount();
+    for (uint32_t i = 0; i < count; i++)
+    {
+        auto* file = folder[i];
+        if (file->format() != KFMTFile::FileFormat::Folder) files.push_back(file);
+        if (file->format() == KFMTFile::FileFormat::Folder
+            || file->dataType() == KFMTFile::DataType::Container)
+            collectFiles(*file, files);
+    }
+}
+
+/*!
+ * \brief Runs a job for every file on the pool.
+ * \return Sum of what the jobs returned, e.g. the number of files they wrote.
+ */
+template<class Job>
+size_t runJobs(QThreadPool& pool, const std::vector<KFMTFile*>& files, Job job)
+{
+    std::atomic<size_t> outputs {0};
+    for (auto* file : files)
+        pool.start([file, &job, &outputs]() {
+            outputs.fetch_add(job(*file), std::memory_order_relaxed);
+        });
+    pool.waitForDone();
+    return outputs.load();
+}
+} // namespace
+
+bool BatchMode::isCommand(const QString& argument)
+{
+    return argument == extractCommand || argument == exportTexturesCommand
+           || argument == exportModelsCommand || argument == verifyCommand
+           || argument == benchmarkCommand;
+}
+
+int BatchMode::run(const QStringList& arguments)
+{
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Runs FSModTool jobs without the GUI."));
+    parser.addHelpOption();
+    parser.addPositionalArgument(QStringLiteral("command"),
+                                 QStringLiteral("extract, export-textures, export-models, verify "
+                                                "or benchmark."));
+    parser.addPositionalArgument(QStringLiteral("source"),
+                                 QStringLiteral("Game directory or disc image (.cue, .bin, .iso)."));
+    parser.addPositionalArgument(QStringLiteral("output"),
+                                 QStringLiteral("Output directory, for every command but verify."));
+    const QCommandLineOption threadsOption(QStringLiteral("threads"),
+                                           QStringLiteral("Number of worker threads."),
+                                           QStringLiteral("count"));
+    parser.addOption(threadsOption);
+    const QCommandLineOption itemsOption(QStringLiteral("items"),
+                                         QStringLiteral("Benchmarks: subfiles, textures, vertices "
+                                                        "etc. in each synthetic file."),
+                                         QStringLiteral("count"), QStringLiteral("256"));
+    parser.addOption(itemsOption);
+    const QCommandLineOption minTimeOption(QStringLiteral("min-time"),
+                                           QStringLiteral("Benchmarks: how long to repeat each "
+                                                          "one for."),
+                                           QStringLiteral("ms"), QStringLiteral("500"));
+    parser.addOption(minTimeOption);
+    parser.process(arguments);
+
+    const auto positional = parser.positionalArguments();
+    const auto command = positional.value(0);
+    if (command == benchmarkCommand)
+    {
+        if (positional.size() != 1)
+        {
+            std::cerr << parser.helpText().toStdString();
+            return 2;
+        }
+        return runBenchmarks(parser.value(itemsOption).toULongLong(),
+                             parser.value(minTimeOption).toLongLong());
+    }
+    const bool needsOutput = command != verifyCommand;
+    if (!isCommand(command) || positional.size() != (needsOutput ? 3 : 2))
+    {
+        std::cerr << parser.helpText().toStdString();
+        return 2;
+    }
+
+    QThreadPool pool;
+    if (parser.isSet(threadsOption))
+    {
+        bool isNumber = false;
+        const auto threads = parser.value(threadsOption).toInt(&isNumber);
+        if (!isNumber || threads < 1)
+        {
+            std::cerr << "--threads needs a positive number.\n";
+            return 2;
+        }
+        pool.setMaxThreadCount(threads);
+    }
+
+    const QDir outDir(needsOutput ? positional[2] : QString());
+    if (needsOutput && !outDir.mkpath(QStringLiteral(".")))
+    {
+        KFMTError::error(QStringLiteral("Couldn't create %1.").arg(outDir.path()));
+        return 1;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    const QFileInfo source(positional[1]);
+    if (source.isDir())
+        core.loadFrom(QDir(source.filePath()));
+    else
+        core.loadFromImage(source.filePath());
+    if (core.currentGame() == KFMTCore::SimpleGame::None)
+    {
+        KFMTError::error(QStringLiteral("Couldn't load a game from %1.").arg(source.filePath()));
+        return 1;
+    }
+    report(command, QStringLiteral("load"), {{QStringLiteral("ms"), timer.restart()}});
+
+    std::vector<KFMTFile*> files;
+    collectFiles(core.files, files);
+    report(command, QStringLiteral("index"),
+           {{QStringLiteral("files"), static_cast<qint64>(files.size())},
+            {QStringLiteral("ms"), timer.restart()}});
+
+    // Each job only reads its own file and writes its own outputs.
+    const auto keep = [&files](KFMTFile::DataType dataType) {
+        files.erase(std::remove_if(files.begin(), files.end(),
+                                   [dataType](const KFMTFile* file) {
+                                       return file->dataType() != dataType;
+                                   }),
+                    files.end());
+    };
+    size_t outputs = 0;
+    int exitCode = 0;
+    if (command == extractCommand)
+    {
+        keep(KFMTFile::DataType::Container);
+        for (const auto* file : files)
+            outDir.mkpath(file->path());
+        std::atomic<size_t> failures {0};
+        outputs = runJobs(pool, files, [&outDir, &failures](KFMTFile& file) -> size_t {
+            if (file.extractTo(outDir.filePath(file.path()))) return file.childCount();
+            failures.fetch_add(1, std::memory_order_relaxed);
+            return 0;
+        });
+        // Which files failed was already logged by extractTo.
+        if (failures.load() != 0)
+        {
+            report(command, QStringLiteral("failures"),
+                   {{QStringLiteral("files"), static_cast<qint64>(failures.load())}});
+            exitCode = 1;
+        }
+    }
+    else if (command == exportTexturesCommand)
+    {
+        keep(KFMTFile::DataType::TextureDB);
+        for (const auto* file : files)
+            outDir.mkpath(file->path());
+        outputs = runJobs(pool, files, [&outDir](KFMTFile& file) {
+            return TextureDB(file).exportAll(outDir.filePath(file.path()));
+        });
+    }
+    else if (command == exportModelsCommand)
+    {
+        keep(KFMTFile::DataType::Model);
+        for (const auto* file : files)
+            outDir.mkpath(QFileInfo(file->path()).path());
+        outputs = runJobs(pool, files, [&outDir](KFMTFile& file) -> size_t {
+            QSaveFile output(outDir.filePath(file.path() + QStringLiteral(".obj")));
+            if (!output.open(QIODevice::WriteOnly)) return 0;
+            Model(file).writeOBJ(output);
+            return output.commit() ? 1 : 0;
+        });
+    }
+    else
+    {
+        // Checksums were verified when loading, this only reports them.
+        for (const auto* file : files)
+        {
+            if (!file->hasBadChecksum()) continue;
+            report(command, QStringLiteral("badChecksum"), {{QStringLiteral("path"), file->path()}});
+            outputs++;
+        }
+        if (outputs != 0) exitCode = 1;
+    }
+
+    report(command, QStringLiteral("run"),
+           {{QStringLiteral("files"), static_cast<qint64>(files.size())},
+            {QStringLiteral("outputs"), static_cast<qint64>(outputs)},
+            {QStringLiteral("threads"), pool.maxThreadCount()},
+            {QStringLiteral("ms"), timer.elapsed()}});
+    return exitCode;
+}
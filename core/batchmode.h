@@ -0,0 +1,32 @@
+#ifndef BATCHMODE_H
+#define BATCHMODE_H
+
+#include <QStringList>
+
+/*!
+ * \brief Headless entry point, for running jobs on whole games without a display.
+ * Usage: FSModTool <command> <game directory or disc image> [output directory] [--threads N]
+ * Commands are extract, export-textures, export-models and verify. Errors go to stderr, while
+ * stdout gets one JSON object per line with the timings of each phase, so runs can be compared
+ * between releases.
+ * FSModTool benchmark [--items N] [--min-time ms] runs Benchmarks instead, which don't need a
+ * game.
+ */
+namespace BatchMode
+{
+
+/*!
+ * \brief Whether the first command line argument is a batch command.
+ */
+[[nodiscard]] bool isCommand(const QString& argument);
+
+/*!
+ * \brief Runs a batch command.
+ * \param arguments Command line arguments, including the program name.
+ * \return Exit code: 0 on success, 1 if the job failed (or found bad files), 2 on bad usage.
+ */
+int run(const QStringList& arguments);
+
+} // namespace BatchMode
+
+#endif // BATCHMODE_H
@@ -0,0 +1,688 @@
+#include "benchmarks.h"
+#include "core/discimage.h"
+#include "core/kfmtcore.h"
+#include "core/kfmtfile.h"
+#include "datahandlers/model.h"
+#include "datahandlers/texturedb.h"
+#include "models/filelistmodel.h"
+#include "utilities.h"
+#include <QBuffer>
+#include <QDataStream>
+#include <QElapsedTimer>
+#include <QTemporaryDir>
+#include <QtEndian>
+#include <algorithm>
+#include <cstring>
+#include <random>
+
+namespace
+{
+constexpr uint32_t sectorSize = 2048;
+constexpr uint32_t pvdSector = 16;
+
+// Results go here, so the compiler can't drop work whose result isn't used.
+volatile size_t sink = 0;
+
+void keep(size_t result)
+{
+    sink = sink + result;
+}
+
+QByteArray randomBytes(std::mt19937& rng, uint32_t size)
+{
+    QByteArray data(static_cast<int>(size), Qt::Uninitialized);
+    for (auto& byte : data)
+        byte = static_cast<char>(rng());
+    return data;
+}
+
+/*!
+ * \brief Visits every file under this one, through the same calls the editors use.
+ * \return How many files there are, this one included.
+ */
+size_t walkTree(KFMTFile& file)
+{
+    size_t files = 1;
+    const auto childCount = file.childCount();
+    for (uint32_t childNo = 0; childNo < childCount; childNo++)
+        files += walkTree(*file[childNo]);
+    return files;
+}
+
+/*!
+ * \brief Visits every row under an index, like a view scrolling through the fully expanded tree.
+ * Views ask for the index of every row they lay out, and for its parent to place it.
+ * \return How many rows there are.
+ */
+size_t walkModel(const FileListModel& model, const QModelIndex& parent)
+{
+    size_t rows = 0;
+    const auto rowCount = model.rowCount(parent);
+    for (int row = 0; row < rowCount; row++)
+    {
+        const auto index = model.index(row, 0, parent);
+        keep(static_cast<size_t>(model.parent(index).row() + 1));
+        rows++;
+        if (model.hasChildren(index)) rows += walkModel(model, index);
+    }
+    return rows;
+}
+
+/*!
+ * \brief Makes a T file. Every fourth subfile has a second entry in the offset table, like the
+ * ones the games reference twice.
+ */
+QByteArray makeT(std::mt19937& rng, size_t count)
+{
+    QByteArray t(sectorSize, '\0');
+    std::vector<uint16_t> entries;
+    uint32_t sector = 1;
+    for (size_t i = 0; i < count; i++)
+    {
+        // Subfiles end with their checksum, and are padded out to the next sector.
+        auto data = randomBytes(rng, 256 * (1 + rng() % 24));
+        const auto size = static_cast<uint32_t>(data.size());
+        Utilities::as<uint32_t>(data, size - 4) = Utilities::tChecksum(data);
+        const auto sectors = (size + sectorSize - 1) / sectorSize;
+        data.append(QByteArray(static_cast<int>(sectors * sectorSize - size), '\0'));
+        t.append(data);
+
+        entries.push_back(static_cast<uint16_t>(sector));
+        if (i % 4 == 3) entries.push_back(static_cast<uint16_t>(sector));
+        sector += sectors;
+    }
+    entries.push_back(static_cast<uint16_t>(sector));
+
+    Utilities::as<uint16_t>(t) = static_cast<uint16_t>(entries.size() - 1);
+    for (uint32_t i = 0; i < entries.size(); i++)
+        Utilities::as<uint16_t>(t, 2 + i * 2) = entries[i];
+    return t;
+}
+
+QByteArray makeMIXWithSizes(std::mt19937& rng, size_t count)
+{
+    QByteArray mix;
+    QDataStream stream(&mix, QIODevice::WriteOnly);
+    stream.setByteOrder(QDataStream::LittleEndian);
+    for (size_t i = 0; i < count; i++)
+    {
+        const auto data = randomBytes(rng, 64 * (1 + rng() % 64));
+        stream << static_cast<uint32_t>(data.size());
+        stream.writeRawData(data.constData(), data.size());
+    }
+    return mix;
+}
+
+/*!
+ * \brief Writes a 4-bit TIM file with a 16 colour CLUT.
+ * \param width Width in pixels, a multiple of 4.
+ */
+void writeTIM(QDataStream& stream, std::mt19937& rng, uint16_t width, uint16_t height)
+{
+    stream << uint32_t {0x10} << uint32_t {0x08};
+    stream << uint32_t {12 + 16 * 2} << uint16_t {0} << uint16_t {480} << uint16_t {16}
+           << uint16_t {1};
+    for (int i = 0; i < 16; i++)
+        stream << static_cast<uint16_t>(rng());
+
+    // Widths are in 16-bit units, so 4 pixels each.
+    const auto words = static_cast<uint16_t>(width / 4);
+    stream << static_cast<uint32_t>(12 + words * height * 2) << uint16_t {640} << uint16_t {0}
+           << words << height;
+    for (uint32_t i = 0; i < static_cast<uint32_t>(words * height); i++)
+        stream << static_cast<uint16_t>(rng());
+}
+
+QByteArray makeTIM(std::mt19937& rng, uint16_t width, uint16_t height)
+{
+    QByteArray tim;
+    QDataStream stream(&tim, QIODevice::WriteOnly);
+    stream.setByteOrder(QDataStream::LittleEndian);
+    writeTIM(stream, rng, width, height);
+    return tim;
+}
+
+/*!
+ * \brief Makes an RTIM file out of 64x64 4-bit textures.
+ */
+QByteArray makeRTIM(std::mt19937& rng, size_t count)
+{
+    QByteArray rtim;
+    QDataStream stream(&rtim, QIODevice::WriteOnly);
+    stream.setByteOrder(QDataStream::LittleEndian);
+    for (size_t i = 0; i < count; i++)
+    {
+        // RTIM headers are written twice.
+        const auto clutY = static_cast<uint16_t>(480 + i % 32);
+        for (int copy = 0; copy < 2; copy++)
+            stream << uint16_t {0} << clutY << uint16_t {16} << uint16_t {1};
+        for (int entry = 0; entry < 16; entry++)
+            stream << static_cast<uint16_t>(rng());
+
+        for (int copy = 0; copy < 2; copy++)
+            stream << uint16_t {640} << uint16_t {0} << uint16_t {16} << uint16_t {64};
+        for (int word = 0; word < 16 * 64; word++)
+            stream << static_cast<uint16_t>(rng());
+    }
+    return rtim;
+}
+
+/*!
+ * \brief Makes a TMD file, or an RTMD file (whose indices are byte offsets instead).
+ * Primitives alternate between flat textured triangles (0x24) and quads (0x2C).
+ */
+QByteArray makeTMD(std::mt19937& rng, uint32_t objects, uint32_t vertices, uint32_t primitives,
+                   bool isRTMD)
+{
+    const uint32_t indexScale = isRTMD ? 8 : 1;
+    const auto index = [&rng, vertices, indexScale]() {
+        return static_cast<uint16_t>(rng() % vertices * indexScale);
+    };
+
+    // Object table offsets are relative to the table itself.
+    const uint32_t tableSize = objects * 28;
+    QByteArray table;
+    QDataStream tableStream(&table, QIODevice::WriteOnly);
+    tableStream.setByteOrder(QDataStream::LittleEndian);
+    QByteArray objectData;
+    QDataStream stream(&objectData, QIODevice::WriteOnly);
+    stream.setByteOrder(QDataStream::LittleEndian);
+    for (uint32_t object = 0; object < objects; object++)
+    {
+        const auto primitivesOffset = tableSize + static_cast<uint32_t>(objectData.size());
+        for (uint32_t primitive = 0; primitive < primitives; primitive++)
+        {
+            const bool isQuad = primitive % 2 == 1;
+            // olen, ilen, flag and mode
+            stream << static_cast<uint8_t>(isQuad ? 9 : 7) << static_cast<uint8_t>(isQuad ? 7 : 5)
+                   << uint8_t {0} << static_cast<uint8_t>(isQuad ? 0x2C : 0x24);
+            // UVs, CLUT, texture page and padding
+            for (int i = 0; i < (isQuad ? 8 : 6); i++)
+                stream << static_cast<uint16_t>(rng());
+            // Normal, then the vertices
+            for (int i = 0; i < (isQuad ? 5 : 4); i++)
+                stream << index();
+            if (isQuad) stream << uint16_t {0};
+        }
+
+        // Vertices and normals are SVECTORs.
+        const auto verticesOffset = tableSize + static_cast<uint32_t>(objectData.size());
+        for (uint32_t i = 0; i < vertices * 2; i++)
+            stream << static_cast<int16_t>(rng()) << static_cast<int16_t>(rng())
+                   << static_cast<int16_t>(rng()) << int16_t {0};
+        const auto normalsOffset = verticesOffset + vertices * 8;
+
+        tableStream << verticesOffset << vertices << normalsOffset << vertices << primitivesOffset
+                    << primitives << int32_t {4096};
+    }
+
+    QByteArray tmd;
+    QDataStream header(&tmd, QIODevice::WriteOnly);
+    header.setByteOrder(QDataStream::LittleEndian);
+    header << uint32_t {isRTMD ? 0u : 0x41u} << uint32_t {isRTMD ? 0x12u : 0u} << objects;
+    tmd.append(table);
+    tmd.append(objectData);
+
+    // Shadow Tower TMDs are told apart by what comes after the first primitive count, so make sure
+    // this isn't taken for one.
+    while (!isRTMD && Utilities::fileIsSTTMD(tmd))
+        Utilities::as<int32_t>(tmd, 12 + 24)++;
+    return tmd;
+}
+
+/*!
+ * \brief Makes a MIX file without sizes, out of 16x16 TIM files with a small TMD every fourth file.
+ */
+QByteArray makeMIXWithoutSizes(std::mt19937& rng, size_t count)
+{
+    QByteArray mix;
+    // The first file decides which kind of MIX this is, so that one has to be a TIM.
+    for (size_t i = 0; i < count; i++)
+    {
+        if (i % 4 == 3)
+            mix.append(makeTMD(rng, 1, 16, 16, false));
+        else
+            mix.append(makeTIM(rng, 16, 16));
+    }
+    return mix;
+}
+
+/*!
+ * \brief Makes a MO file with a single object TMD.
+ * Morph targets move five vertices, then skip three with a dummy packet, all the way through.
+ * Every frame blends two morph targets.
+ */
+QByteArray makeMO(std::mt19937& rng, uint32_t vertices, uint32_t targets, uint32_t animations,
+                  uint32_t framesPerAnimation)
+{
+    QByteArray mo(20, '\0');
+    mo.append(makeTMD(rng, 1, vertices, vertices, false));
+    while (mo.size() % 4 != 0)
+        mo.append('\0');
+
+    const auto targetTableOffset = static_cast<uint32_t>(mo.size());
+    mo.append(QByteArray(static_cast<int>(targets * 4), '\0'));
+    for (uint32_t target = 0; target < targets; target++)
+    {
+        Utilities::as<uint32_t>(mo, targetTableOffset + target * 4)
+            = static_cast<uint32_t>(mo.size());
+
+        QByteArray packets;
+        QDataStream stream(&packets, QIODevice::WriteOnly);
+        stream.setByteOrder(QDataStream::LittleEndian);
+        stream << uint16_t {0}; // Packet count, filled in below
+        uint16_t packetCount = 0;
+        for (uint32_t vertex = 0; vertex < vertices; packetCount++)
+        {
+            if (vertex % 8 < 5)
+            {
+                stream << static_cast<int16_t>(rng() % 8192 + 1)
+                       << static_cast<int16_t>(rng() % 8192 + 1)
+                       << static_cast<int16_t>(rng() % 8192 + 1);
+                vertex++;
+                continue;
+            }
+
+            const auto skipped = std::min(3u, vertices - vertex);
+            stream << int16_t {static_cast<int16_t>(0x8000)} << static_cast<int16_t>(skipped);
+            vertex += skipped;
+        }
+
+        Utilities::as<uint16_t>(packets) = packetCount;
+        mo.append(packets);
+    }
+
+    while (mo.size() % 4 != 0)
+        mo.append('\0');
+    const auto animationTableOffset = static_cast<uint32_t>(mo.size());
+    mo.append(QByteArray(static_cast<int>(animations * 4), '\0'));
+    for (uint32_t animation = 0; animation < animations; animation++)
+    {
+        const auto animationOffset = static_cast<uint32_t>(mo.size());
+        Utilities::as<uint32_t>(mo, animationTableOffset + animation * 4) = animationOffset;
+        mo.append(QByteArray(static_cast<int>(4 + framesPerAnimation * 4), '\0'));
+        Utilities::as<uint32_t>(mo, animationOffset) = framesPerAnimation;
+
+        for (uint32_t frame = 0; frame < framesPerAnimation; frame++)
+        {
+            Utilities::as<uint32_t>(mo, animationOffset + 4 + frame * 4)
+                = static_cast<uint32_t>(mo.size());
+            QByteArray frameData;
+            QDataStream stream(&frameData, QIODevice::WriteOnly);
+            stream.setByteOrder(QDataStream::LittleEndian);
+            stream << int16_t {0} << int16_t {4096} << static_cast<int16_t>(frame) << int16_t {2}
+                   << static_cast<uint16_t>(rng() % targets)
+                   << static_cast<uint16_t>(rng() % targets);
+            mo.append(frameData);
+        }
+    }
+
+    Utilities::as<uint32_t>(mo) = static_cast<uint32_t>(mo.size());
+    Utilities::as<uint32_t>(mo, 4) = animations;
+    Utilities::as<uint32_t>(mo, 8) = 20;
+    Utilities::as<uint32_t>(mo, 12) = targetTableOffset;
+    Utilities::as<uint32_t>(mo, 16) = animationTableOffset;
+    return mo;
+}
+
+/*!
+ * \brief Writes a value to an ISO9660 both-endian field.
+ */
+void writeBothEndian(QByteArray& data, int offset, uint32_t value)
+{
+    auto* field = reinterpret_cast<uchar*>(data.data() + offset);
+    qToLittleEndian<quint32>(value, field);
+    qToBigEndian<quint32>(value, field + 4);
+}
+
+/*!
+ * \brief Makes an ISO9660 image with 2048-byte sectors and every file in its root directory.
+ * \param names Gets the names of the files, in the order they are on the disc.
+ * \param fileBytes Gets the total size of the files.
+ */
+QByteArray makeISO(std::mt19937& rng, size_t count, std::vector<QString>& names, size_t& fileBytes)
+{
+    constexpr uint32_t rootLba = pvdSector + 2;
+    std::vector<QByteArray> files;
+    fileBytes = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        files.push_back(randomBytes(rng, 256 * (1 + rng() % 96)));
+        names.push_back(QStringLiteral("FILE%1.BIN").arg(i, 4, 10, QLatin1Char('0')));
+        fileBytes += static_cast<size_t>(files.back().size());
+    }
+
+    // Records never cross sectors. Every record has the same size here, so the size of the
+    // directory doesn't depend on where the files go.
+    const auto makeDirectory = [&files, &names](uint32_t directorySize, uint32_t firstFileLba) {
+        QByteArray directory;
+        const auto appendRecord = [&directory](uint32_t lba, uint32_t size, bool isDirectory,
+                                               const QByteArray& name) {
+            const auto length = 33 + name.size() + (name.size() % 2 == 0 ? 1 : 0);
+            const auto sectorUsed = directory.size() % static_cast<int>(sectorSize);
+            if (sectorUsed + length > static_cast<int>(sectorSize))
+                directory.append(QByteArray(static_cast<int>(sectorSize) - sectorUsed, '\0'));
+            QByteArray record(length, '\0');
+            record[0] = static_cast<char>(length);
+            writeBothEndian(record, 2, lba);
+            writeBothEndian(record, 10, size);
+            record[25] = isDirectory ? 0x02 : 0x00;
+            record[32] = static_cast<char>(name.size());
+            std::memcpy(record.data() + 33, name.constData(), static_cast<size_t>(name.size()));
+            directory.append(record);
+        };
+
+        // The directory itself and its parent, which is also the root.
+        appendRecord(rootLba, directorySize, true, QByteArray(1, '\0'));
+        appendRecord(rootLba, directorySize, true, QByteArray(1, '\1'));
+        auto lba = firstFileLba;
+        for (size_t i = 0; i < files.size(); i++)
+        {
+            const auto size = static_cast<uint32_t>(files[i].size());
+            appendRecord(lba, size, false, names[i].toLatin1() + ";1");
+            lba += (size + sectorSize - 1) / sectorSize;
+        }
+        const auto padding = (sectorSize - directory.size() % sectorSize) % sectorSize;
+        directory.append(QByteArray(static_cast<int>(padding), '\0'));
+        return directory;
+    };
+    const auto directorySize = static_cast<uint32_t>(makeDirectory(0, 0).size());
+    const auto directory = makeDirectory(directorySize, rootLba + directorySize / sectorSize);
+
+    QByteArray image(static_cast<int>(pvdSector * sectorSize), '\0');
+    QByteArray pvd(sectorSize, '\0');
+    pvd[0] = 1;
+    std::memcpy(pvd.data() + 1, "CD001\1", 6);
+    pvd[156] = 34;
+    writeBothEndian(pvd, 156 + 2, rootLba);
+    writeBothEndian(pvd, 156 + 10, directorySize);
+    pvd[156 + 25] = 0x02;
+    pvd[156 + 32] = 1;
+    QByteArray terminator(sectorSize, '\0');
+    terminator[0] = static_cast<char>(0xFF);
+    std::memcpy(terminator.data() + 1, "CD001\1", 6);
+    image.append(pvd).append(terminator).append(directory);
+    for (auto& file : files)
+    {
+        const auto padding = (sectorSize - file.size() % sectorSize) % sectorSize;
+        image.append(file).append(QByteArray(static_cast<int>(padding), '\0'));
+    }
+
+    writeBothEndian(image, static_cast<int>(pvdSector * sectorSize + 80),
+                    static_cast<uint32_t>(image.size()) / sectorSize);
+    return image;
+}
+
+/*!
+ * \brief Turns an ISO image into a raw one with 2352-byte Mode 2 Form 1 sectors.
+ * The EDC and ECC are left empty, since reading doesn't check them.
+ */
+QByteArray makeRawImage(const QByteArray& iso)
+{
+    constexpr int rawSectorSize = 2352;
+    constexpr uint8_t syncPattern[12] = {
+        0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x00};
+    const auto toBcd = [](uint32_t value) {
+        return static_cast<char>(((value / 10) << 4) | (value % 10));
+    };
+
+    const auto sectors = static_cast<uint32_t>(iso.size()) / sectorSize;
+    QByteArray raw(static_cast<int>(sectors) * rawSectorSize, '\0');
+    for (uint32_t sectorNo = 0; sectorNo < sectors; sectorNo++)
+    {
+        auto* sector = raw.data() + sectorNo * rawSectorSize;
+        std::memcpy(sector, syncPattern, sizeof(syncPattern));
+        // Addresses count from the 2 second pregap, at 75 sectors per second.
+        const auto address = sectorNo + 150;
+        sector[12] = toBcd(address / 75 / 60);
+        sector[13] = toBcd(address / 75 % 60);
+        sector[14] = toBcd(address % 75);
+        sector[15] = 2;
+        sector[18] = sector[22] = 0x08;
+        std::memcpy(sector + 24, iso.constData() + sectorNo * sectorSize, sectorSize);
+    }
+    return raw;
+}
+} // namespace
+
+std::vector<Benchmarks::Result> Benchmarks::run(size_t items, qint64 minTimeMs)
+{
+    // Same seed every time, so every run works on the same files.
+    std::mt19937 rng(0x46534D54);
+    const auto count = std::max<size_t>(items, 4);
+    // T offset tables fit in one sector and RTMD indices are 16-bit byte offsets, so those are
+    // capped. MOs are kept to the size of the biggest real ones.
+    const auto tCount = std::min<size_t>(count, 800);
+    // The file tree has a folder for every 16 items, each with 16 T files of 64 subfiles.
+    const auto treeFolders = std::min<size_t>(count / 16 + 1, 256);
+    constexpr size_t treeTFiles = 16;
+    constexpr size_t treeTSubfiles = 64;
+    const auto vertexCount = static_cast<uint32_t>(std::min<size_t>(count, 8000));
+    const auto moVertexCount = static_cast<uint32_t>(std::min<size_t>(count, 256));
+    const auto moTargetCount = static_cast<uint32_t>(std::min<size_t>(count, 1024));
+    const auto timSide = static_cast<uint16_t>(std::clamp<size_t>(count, 16, 1024) & ~size_t {3});
+    constexpr uint32_t tmdObjects = 4;
+    constexpr uint32_t moAnimations = 8;
+
+    const auto t = makeT(rng, tCount);
+    const auto mixWithSizes = makeMIXWithSizes(rng, count);
+    const auto mixWithoutSizes = makeMIXWithoutSizes(rng, count);
+    const auto tmd = makeTMD(rng, tmdObjects, vertexCount, vertexCount, false);
+    const auto rtmd = makeTMD(rng, tmdObjects, vertexCount, vertexCount, true);
+    const auto mo = makeMO(rng, moVertexCount, moTargetCount, moAnimations,
+                           std::max(1u, moTargetCount / moAnimations));
+    const auto tim = makeTIM(rng, timSide, timSide);
+    const auto rtim = makeRTIM(rng, count);
+    const auto svectorCount = size_t {vertexCount} * tmdObjects;
+    const auto svectors = randomBytes(rng,
+                                      static_cast<uint32_t>(svectorCount * sizeof(PS1::SVECTOR)));
+
+    std::vector<Result> results;
+    const auto measure = [&results, minTimeMs](const QString& name, const QString& unit,
+                                               size_t bytes, size_t itemCount, auto body) {
+        // Once first, so the timing doesn't include faulting the files in.
+        body();
+
+        Result result {name, unit, bytes, itemCount, 0, 0};
+        QElapsedTimer timer;
+        timer.start();
+        do
+        {
+            body();
+            result.iterations++;
+        } while (timer.elapsed() < minTimeMs);
+        result.nanoseconds = timer.nsecsElapsed();
+        results.push_back(result);
+    };
+
+    // Sniffers, on every file above plus some noise.
+    std::vector<QByteArray> sniffed {t, mixWithSizes, mixWithoutSizes, tmd, rtmd, mo, tim, rtim};
+    for (int i = 0; i < 56; i++)
+        sniffed.push_back(randomBytes(rng, 256));
+    size_t sniffedBytes = 0;
+    for (const auto& file : sniffed)
+        sniffedBytes += static_cast<size_t>(file.size());
+
+    measure(QStringLiteral("Utilities::fileIs*"), QStringLiteral("checks"), sniffedBytes,
+            sniffed.size() * 9, [&sniffed]() {
+                for (const auto& file : sniffed)
+                    keep(Utilities::fileIsMO(file) + Utilities::fileIsPSXEXE(file)
+                         + Utilities::fileIsRTIM(file) + Utilities::fileIsRTMD(file)
+                         + Utilities::fileIsSEQ(file) + Utilities::fileIsTIM(file)
+                         + Utilities::fileIsTMD(file) + Utilities::fileIsVB(file)
+                         + Utilities::fileIsVH(file));
+            });
+    measure(QStringLiteral("Utilities::detectFormat"), QStringLiteral("files"), sniffedBytes,
+            sniffed.size(), [&sniffed]() {
+                for (const auto& file : sniffed)
+                    keep(static_cast<size_t>(Utilities::detectFormat(file)));
+            });
+
+    // Containers.
+    const auto splitContainer = [](const QByteArray& data, KFMTFile::FileFormat format) {
+        KFMTFile file(QStringLiteral("BENCH"), data, nullptr, format,
+                      KFMTFile::DataType::Container);
+        file.expand();
+        keep(file.m_subFiles.size());
+    };
+    measure(QStringLiteral("KFMTFile::loadT"), QStringLiteral("subfiles"), t.size(), tCount,
+            [&]() { splitContainer(t, KFMTFile::FileFormat::T); });
+    measure(QStringLiteral("KFMTFile::loadMIX (sizes)"), QStringLiteral("subfiles"),
+            mixWithSizes.size(), count,
+            [&]() { splitContainer(mixWithSizes, KFMTFile::FileFormat::MIX); });
+    measure(QStringLiteral("KFMTFile::loadMIX (no sizes)"), QStringLiteral("subfiles"),
+            mixWithoutSizes.size(), count,
+            [&]() { splitContainer(mixWithoutSizes, KFMTFile::FileFormat::MIX); });
+
+    // One changed subfile, so the whole T file is rebuilt every time.
+    KFMTFile tFile(QStringLiteral("BENCH.T"), t, nullptr, KFMTFile::FileFormat::T,
+                   KFMTFile::DataType::Container);
+    tFile.expand();
+    tFile.m_subFiles.front()->dataChanged();
+    measure(QStringLiteral("KFMTFile::writeT"), QStringLiteral("subfiles"), t.size(), tCount,
+            [&tFile]() {
+                QByteArray output;
+                QBuffer buffer(&output);
+                buffer.open(QIODevice::WriteOnly);
+                tFile.writeContents(buffer);
+                keep(static_cast<size_t>(output.size()));
+            });
+
+    // The file tree. It goes into core.files, since that's the tree FileListModel shows. Every
+    // folder has the same T files, which share their data but are split separately.
+    const auto treeT = makeT(rng, treeTSubfiles);
+    const auto buildTree = [&treeT, treeFolders]() {
+        core.files.resetRoot();
+        for (size_t folderNo = 0; folderNo < treeFolders; folderNo++)
+        {
+            core.files.createChild(QStringLiteral("DIR%1").arg(folderNo), QByteArray(),
+                                   KFMTFile::FileFormat::Folder, KFMTFile::DataType::Container);
+            auto& folder = *core.files.m_subFiles.back();
+            for (size_t tNo = 0; tNo < treeTFiles; tNo++)
+            {
+                folder.createChild(QStringLiteral("FILE%1.T").arg(tNo), treeT,
+                                   KFMTFile::FileFormat::T, KFMTFile::DataType::Container);
+                folder.m_subFiles.back()->expand();
+            }
+        }
+    };
+    const auto treeBytes = static_cast<size_t>(treeT.size()) * treeFolders * treeTFiles;
+    buildTree();
+    const auto treeFiles = walkTree(core.files) - 1;
+    measure(QStringLiteral("KFMTFile tree (build)"), QStringLiteral("files"), treeBytes,
+            treeFiles, buildTree);
+    measure(QStringLiteral("KFMTFile tree (walk)"), QStringLiteral("files"), treeBytes, treeFiles,
+            []() { keep(walkTree(core.files)); });
+    const FileListModel fileListModel;
+    measure(QStringLiteral("FileListModel::index/parent"), QStringLiteral("rows"), treeBytes,
+            treeFiles, [&fileListModel]() { keep(walkModel(fileListModel, QModelIndex())); });
+
+    // Path lookups of every T subfile. Lookups through the root are cached after the first one,
+    // while lookups through anything else go down the tree every time.
+    std::vector<QString> rootPaths;
+    std::vector<std::pair<KFMTFile*, QString>> folderPaths;
+    for (const auto& folder : core.files.m_subFiles)
+        for (const auto& tFile : folder->m_subFiles)
+            for (const auto& subFile : tFile->m_subFiles)
+            {
+                rootPaths.push_back(subFile->path());
+                folderPaths.emplace_back(folder.get(),
+                                         tFile->name() + QLatin1Char('/') + subFile->name());
+            }
+    measure(QStringLiteral("KFMTFile::operator[] (root, cached)"), QStringLiteral("lookups"),
+            treeBytes, rootPaths.size(), [&rootPaths]() {
+                for (const auto& path : rootPaths)
+                    keep(core.files[QStringView(path)] != nullptr);
+            });
+    measure(QStringLiteral("KFMTFile::operator[] (folder)"), QStringLiteral("lookups"), treeBytes,
+            folderPaths.size(), [&folderPaths]() {
+                for (const auto& [folder, path] : folderPaths)
+                    keep((*folder)[QStringView(path)] != nullptr);
+            });
+    core.files.resetRoot();
+
+    // Disc images. Loading a game from one reads every file in the file lists out of the image
+    // right away, copying it and, for raw images, gathering it from between the sector headers.
+    std::vector<QString> imageFiles;
+    size_t imageFileBytes = 0;
+    const auto iso = makeISO(rng, count, imageFiles, imageFileBytes);
+    const std::pair<QString, QByteArray> images[] = {{QStringLiteral("ISO"), iso},
+                                                     {QStringLiteral("BIN"), makeRawImage(iso)}};
+    QTemporaryDir imageDirectory;
+    for (const auto& [format, data] : images)
+    {
+        const auto path = imageDirectory.filePath(QStringLiteral("BENCH.") + format);
+        {
+            QFile file(path);
+            if (!file.open(QIODevice::WriteOnly) || file.write(data) != data.size()) continue;
+        }
+        DiscImage image;
+        if (!image.open(path)) continue;
+        measure(QStringLiteral("DiscImage::read (%1)").arg(format), QStringLiteral("files"),
+                imageFileBytes, imageFiles.size(), [&image, &imageFiles]() {
+                    for (const auto& name : imageFiles)
+                        keep(static_cast<size_t>(image.read(name).size()));
+                });
+    }
+
+    // Models and textures. TMD objects and MO animations are decoded on first use, so they're all
+    // asked for here.
+    const auto loadModel = [](KFMTFile& file) {
+        Model model(file);
+        model.decodeAllObjects();
+        model.decodeAllAnimations();
+        keep(model.baseObjects.size() + model.morphTargets.size());
+    };
+    KFMTFile tmdFile(QStringLiteral("BENCH.TMD"), tmd, nullptr);
+    measure(QStringLiteral("Model::loadTMD"), QStringLiteral("primitives"), tmd.size(),
+            tmdObjects * vertexCount, [&]() { loadModel(tmdFile); });
+    KFMTFile rtmdFile(QStringLiteral("BENCH.RTMD"), rtmd, nullptr);
+    measure(QStringLiteral("Model::loadRTMD"), QStringLiteral("primitives"), rtmd.size(),
+            tmdObjects * vertexCount, [&]() { loadModel(rtmdFile); });
+    measure(QStringLiteral("Model::loadRTMD (one object)"), QStringLiteral("primitives"),
+            rtmd.size(), vertexCount, [&rtmdFile]() {
+                Model model(rtmdFile);
+                keep(model.object(0).primitives.size());
+            });
+    // Triangulation on its own, which the viewers do once per object before uploading it.
+    Model rtmdModel(rtmdFile);
+    rtmdModel.decodeAllObjects();
+    measure(QStringLiteral("Model::triangulate"), QStringLiteral("primitives"), rtmd.size(),
+            tmdObjects * vertexCount, [&rtmdModel]() {
+                for (const auto& object : rtmdModel.baseObjects)
+                    keep(Model::triangulate(object).vertices.size());
+            });
+    KFMTFile moFile(QStringLiteral("BENCH.MO"), mo, nullptr);
+    measure(QStringLiteral("Model::loadMO"), QStringLiteral("morph targets"), mo.size(),
+            moTargetCount, [&]() { loadModel(moFile); });
+    measure(QStringLiteral("Model::loadMO (open)"), QStringLiteral("animations"), mo.size(),
+            moAnimations, [&moFile]() { keep(Model(moFile).animations.size()); });
+    // Morph targets are applied to the base object when they're asked for. Going through all of
+    // them in order mostly misses the cache of recent ones.
+    Model moModel(moFile);
+    measure(QStringLiteral("Model::morphTargetVertices"), QStringLiteral("morph targets"),
+            mo.size(), moTargetCount, [&moModel]() {
+                for (size_t target = 0; target < moModel.morphTargets.size(); target++)
+                    keep(moModel.morphTargetVertices(target)->size());
+            });
+    // The SVECTOR conversion on its own, since every vertex and normal of every model goes
+    // through it.
+    Model::VertexArray convertedVectors;
+    measure(QStringLiteral("Model::VertexArray::assign"), QStringLiteral("vectors"),
+            static_cast<size_t>(svectors.size()), svectorCount, [&]() {
+                convertedVectors.assign(reinterpret_cast<const PS1::SVECTOR*>(svectors.constData()),
+                                        svectorCount);
+                keep(convertedVectors.size());
+            });
+
+    KFMTFile timFile(QStringLiteral("BENCH.TIM"), tim, nullptr);
+    measure(QStringLiteral("TextureDB::loadTIM"), QStringLiteral("pixels"), tim.size(),
+            size_t {timSide} * timSide, [&timFile]() {
+                keep(TextureDB(timFile).getTextureCount());
+            });
+    KFMTFile rtimFile(QStringLiteral("BENCH.RTIM"), rtim, nullptr);
+    measure(QStringLiteral("TextureDB::loadRTIM"), QStringLiteral("textures"), rtim.size(), count,
+            [&rtimFile]() { keep(TextureDB(rtimFile).getTextureCount()); });
+
+    return results;
+}
@@ -0,0 +1,35 @@
+#ifndef BENCHMARKS_H
+#define BENCHMARKS_H
+
+#include <QString>
+#include <vector>
+
+/*!
+ * \brief Benchmarks for the format decoders, the T file writer, the file tree and disc images.
+ * They run on synthetic files made on the fly (T files with duplicate offset entries, MIX files
+ * with and without sizes, TMD, RTMD, MO, TIM and RTIM files, a tree of folders full of T files,
+ * and ISO and raw BIN images), so no game data is needed. Run them with the benchmark batch
+ * command, see BatchMode.
+ */
+class Benchmarks
+{
+public:
+    struct Result
+    {
+        QString name;
+        QString unit;            ///< What items counts, e.g. "subfiles".
+        size_t bytes = 0;        ///< Input size of one iteration.
+        size_t items = 0;        ///< Items handled in one iteration.
+        size_t iterations = 0;
+        qint64 nanoseconds = 0;  ///< Time taken by every iteration together.
+    };
+
+    /*!
+     * \brief Runs every benchmark.
+     * \param items How many subfiles, textures, vertices etc. the synthetic files have.
+     * \param minTimeMs How long each benchmark is repeated for, at least.
+     */
+    static std::vector<Result> run(size_t items, qint64 minTimeMs);
+};
+
+#endif // BENCHMARKS_H
@@ -0,0 +1,157 @@
+#ifndef BINARYREADER_H
+#define BINARYREADER_H
+
+#include <QByteArray>
+#include <QString>
+#include <cstring>
+#include <type_traits>
+
+/*!
+ * \brief Little-endian reader over a span of bytes, for parsing game files.
+ * This replaces QDataStream in the parsers: reads are inlined copies instead of virtual device
+ * calls. Reading, skipping or seeking past the end never touches memory outside the span. It gives
+ * zeroes instead and puts the reader in a failed state, which parsers check with ok() once they're
+ * done and report with errorString().
+ * Like the rest of FSModTool, this assumes the host is little-endian too.
+ */
+class BinaryReader
+{
+public:
+    BinaryReader(const uint8_t* data, size_t size) : m_data(data), m_size(size) {}
+
+    /*!
+     * \brief Reads from a byte array, which has to outlive the reader.
+     */
+    explicit BinaryReader(const QByteArray& data)
+        : BinaryReader(reinterpret_cast<const uint8_t*>(data.constData()),
+                       static_cast<size_t>(data.size()))
+    {}
+
+    template<class T>
+    [[nodiscard]] T read()
+    {
+        static_assert(std::is_trivially_copyable_v<T>, "BinaryReader only reads plain data");
+        T value {};
+        if (reserve(sizeof(T)))
+        {
+            std::memcpy(&value, m_data + m_pos, sizeof(T));
+            m_pos += sizeof(T);
+        }
+        return value;
+    }
+
+    template<class T>
+    BinaryReader& operator>>(T& value)
+    {
+        value = read<T>();
+        return *this;
+    }
+
+    /*!
+     * \brief Copies count values into an array.
+     * \return Whether they were all there. Nothing is copied otherwise.
+     */
+    template<class T>
+    bool readArray(T* values, size_t count)
+    {
+        static_assert(std::is_trivially_copyable_v<T>, "BinaryReader only reads plain data");
+        if (count > m_size / sizeof(T)) return fail(m_pos, count * sizeof(T));
+        if (!reserve(sizeof(T) * count)) return false;
+        std::memcpy(values, m_data + m_pos, sizeof(T) * count);
+        m_pos += sizeof(T) * count;
+        return true;
+    }
+
+    /*!
+     * \brief Returns a view of count values at the current position, and skips past them.
+     * The view points into the data, so it's only valid as long as that is. Unlike the other reads,
+     * this doesn't copy, so T must match the data's layout.
+     * \return The values, or nullptr if they aren't all there.
+     */
+    template<class T>
+    [[nodiscard]] const T* view(size_t count)
+    {
+        static_assert(std::is_trivially_copyable_v<T>, "BinaryReader only reads plain data");
+        if (count > m_size / sizeof(T))
+        {
+            fail(m_pos, count * sizeof(T));
+            return nullptr;
+        }
+        if (!reserve(sizeof(T) * count)) return nullptr;
+        const auto* values = reinterpret_cast<const T*>(m_data + m_pos);
+        m_pos += sizeof(T) * count;
+        return values;
+    }
+
+    void skip(size_t bytes)
+    {
+        if (reserve(bytes)) m_pos += bytes;
+    }
+
+    void seek(size_t pos)
+    {
+        if (!m_failed && pos <= m_size) m_pos = pos;
+        else fail(pos, 0);
+    }
+
+    [[nodiscard]] bool atEnd() const { return m_pos >= m_size; }
+    [[nodiscard]] size_t pos() const { return m_pos; }
+    [[nodiscard]] size_t remaining() const { return m_size - m_pos; }
+    [[nodiscard]] size_t size() const { return m_size; }
+
+    /*!
+     * \brief Whether every read so far was within the data.
+     */
+    [[nodiscard]] bool ok() const { return !m_failed; }
+
+    /*!
+     * \brief Describes the first read that went past the end, for error messages.
+     */
+    [[nodiscard]] QString errorString() const
+    {
+        if (!m_failed) return {};
+        if (m_failSize == 0)
+            return QStringLiteral("Tried to go to offset 0x%1, but the data ends at 0x%2.")
+                .arg(m_failPos, 0, 16)
+                .arg(m_size, 0, 16);
+        return QStringLiteral("Tried to read %1 bytes at offset 0x%2, but the data ends at 0x%3.")
+            .arg(m_failSize)
+            .arg(m_failPos, 0, 16)
+            .arg(m_size, 0, 16);
+    }
+
+private:
+    /*!
+     * \brief Checks whether there are enough bytes left, failing if not.
+     */
+    bool reserve(size_t bytes)
+    {
+        if (!m_failed && bytes <= m_size - m_pos) return true;
+        return fail(m_pos, bytes);
+    }
+
+    /*!
+     * \brief Records the first failure, and moves to the end so loops reading until it stop.
+     * \param bytes Size of the read that failed, or 0 for seeks.
+     */
+    bool fail(size_t pos, size_t bytes)
+    {
+        if (!m_failed)
+        {
+            m_failed = true;
+            m_failPos = pos;
+            m_failSize = bytes;
+        }
+        m_pos = m_size;
+        return false;
+    }
+
+    const uint8_t* m_data;
+    size_t m_size;
+    size_t m_pos = 0;
+    bool m_failed = false;
+    size_t m_failPos = 0;
+    size_t m_failSize = 0;
+};
+
+#endif // BINARYREADER_H
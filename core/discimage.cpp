@@ -0,0 +1,505 @@
+#include "discimage.h"
+#include "kfmterror.h"
+#include <QDir>
+#include <QFileInfo>
+#include <QRegularExpression>
+#include <QtEndian>
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+namespace
+{
+constexpr uint32_t rawSectorSize = 2352;
+constexpr uint32_t pvdSector = 16;
+constexpr int maxDirectoryDepth = 32;
+constexpr uint8_t syncPattern[12] = {
+    0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x00};
+
+/*!
+ * \brief Lookup tables for the CD-ROM EDC (a CRC32) and the Reed-Solomon ECC (over GF(2^8)).
+ */
+struct EccTables
+{
+    std::array<uint8_t, 256> forward {};
+    std::array<uint8_t, 256> backward {};
+    std::array<uint32_t, 256> edc {};
+};
+
+constexpr EccTables makeEccTables()
+{
+    EccTables tables;
+    for (uint32_t i = 0; i < 256; i++)
+    {
+        const uint32_t j = (i << 1) ^ ((i & 0x80) != 0 ? 0x11D : 0);
+        tables.forward[i] = static_cast<uint8_t>(j);
+        tables.backward[i ^ j] = static_cast<uint8_t>(i);
+
+        uint32_t edc = i;
+        for (int bit = 0; bit < 8; bit++)
+            edc = (edc >> 1) ^ ((edc & 1) != 0 ? 0xD8018001 : 0);
+        tables.edc[i] = edc;
+    }
+    return tables;
+}
+
+constexpr auto eccTables = makeEccTables();
+
+uint32_t computeEdc(const uint8_t* data, size_t size)
+{
+    uint32_t edc = 0;
+    for (size_t i = 0; i < size; i++)
+        edc = (edc >> 8) ^ eccTables.edc[(edc ^ data[i]) & 0xFF];
+    return edc;
+}
+
+/*!
+ * \brief Computes one of the two ECC parity blocks (P or Q) of a sector, starting at its header.
+ */
+void computeEccBlock(const uint8_t* source, uint32_t majorCount, uint32_t minorCount,
+                     uint32_t majorMult, uint32_t minorInc, uint8_t* destination)
+{
+    const auto size = majorCount * minorCount;
+    for (uint32_t major = 0; major < majorCount; major++)
+    {
+        auto index = (major >> 1) * majorMult + (major & 1);
+        uint8_t eccA = 0;
+        uint8_t eccB = 0;
+        for (uint32_t minor = 0; minor < minorCount; minor++)
+        {
+            const auto value = source[index];
+            index += minorInc;
+            if (index >= size) index -= size;
+            eccA ^= value;
+            eccB ^= value;
+            eccA = eccTables.forward[eccA];
+        }
+        eccA = eccTables.backward[eccTables.forward[eccA] ^ eccB];
+        destination[major] = eccA;
+        destination[major + majorCount] = eccA ^ eccB;
+    }
+}
+
+/*!
+ * \brief Regenerates the EDC and ECC of a raw Mode 1 or Mode 2 Form 1 sector.
+ */
+void generateEdcEcc(uint8_t* sector)
+{
+    std::array<uint8_t, 4> address {};
+    const bool isMode2 = sector[15] == 2;
+    if (isMode2)
+    {
+        // Form 1: the EDC covers the subheader and the data, and the ECC is computed as if the
+        // header was all zeroes, so sectors can be moved without redoing it.
+        qToLittleEndian<quint32>(computeEdc(sector + 16, 2056), sector + 2072);
+        std::memcpy(address.data(), sector + 12, address.size());
+        std::memset(sector + 12, 0, address.size());
+    }
+    else
+    {
+        qToLittleEndian<quint32>(computeEdc(sector, 2064), sector + 2064);
+        std::memset(sector + 2068, 0, 8);
+    }
+
+    computeEccBlock(sector + 12, 86, 24, 2, 86, sector + 2076);
+    computeEccBlock(sector + 12, 52, 43, 86, 88, sector + 2248);
+
+    if (isMode2) std::memcpy(sector + 12, address.data(), address.size());
+}
+
+constexpr uint8_t toBcd(uint32_t value)
+{
+    return static_cast<uint8_t>(((value / 10) << 4) | (value % 10));
+}
+
+/*!
+ * \brief Turns a path into the form directory entries are stored with.
+ */
+QString entryKey(const QString& path)
+{
+    auto key = QDir::fromNativeSeparators(path).toUpper();
+    while (key.startsWith(QLatin1Char('/')))
+        key.remove(0, 1);
+    while (key.endsWith(QLatin1Char('/')))
+        key.chop(1);
+    return key;
+}
+} // namespace
+
+bool DiscImage::open(const QString& path)
+{
+    m_imagePath = path;
+    m_sectorSize = 0;
+    if (path.endsWith(QStringLiteral(".cue"), Qt::CaseInsensitive) && !parseCue(path))
+        return false;
+
+    m_image.setFileName(m_imagePath);
+    if (!m_image.open(QIODevice::ReadOnly))
+    {
+        KFMTError::error(QStringLiteral("Couldn't open the disc image %1.").arg(m_imagePath));
+        return false;
+    }
+    m_imageSize = m_image.size();
+    m_mapping = m_image.map(0, m_imageSize);
+    if (m_mapping == nullptr)
+    {
+        KFMTError::error(QStringLiteral("Couldn't map the disc image %1.").arg(m_imagePath));
+        return false;
+    }
+
+    // Without a CUE sheet, raw images are told apart by the sync pattern every raw sector starts
+    // with.
+    if (m_sectorSize == 0)
+        m_sectorSize = m_imageSize >= rawSectorSize
+                               && std::memcmp(m_mapping, syncPattern, sizeof(syncPattern)) == 0
+                           ? rawSectorSize
+                           : userDataSize;
+
+    // Mode 2 Form 1 sectors have an 8 byte subheader between the header and the user data. The
+    // mode byte is checked on the volume descriptor, since that's a data sector on every disc.
+    m_userDataOffset = 0;
+    if (m_sectorSize == rawSectorSize)
+    {
+        const qint64 modeOffset = static_cast<qint64>(pvdSector) * rawSectorSize + 15;
+        m_userDataOffset = modeOffset < m_imageSize && m_mapping[modeOffset] == 2 ? 24 : 16;
+    }
+
+    const auto* pvd = userData(pvdSector);
+    if (pvd == nullptr || pvd[0] != 1 || std::memcmp(pvd + 1, "CD001", 5) != 0)
+    {
+        KFMTError::error(QStringLiteral("%1 isn't an ISO9660 disc image.").arg(m_imagePath));
+        return false;
+    }
+
+    // The root directory's record is embedded in the primary volume descriptor.
+    const Extent root {qFromLittleEndian<quint32>(pvd + 156 + 2),
+                       qFromLittleEndian<quint32>(pvd + 156 + 10),
+                       true};
+    m_root = root;
+    m_volumeSectors = qFromLittleEndian<quint32>(pvd + 80);
+    const auto imageSectors = static_cast<uint32_t>(m_imageSize / m_sectorSize);
+    m_trackSectors = m_hasTrailingTracks ? std::min(m_volumeSectors, imageSectors) : imageSectors;
+
+    m_entries.clear();
+    return readDirectory(root, QString(), 0);
+}
+
+bool DiscImage::exists(const QString& path) const
+{
+    return m_entries.contains(entryKey(path));
+}
+
+QByteArray DiscImage::read(const QString& path) const
+{
+    const auto entry = m_entries.constFind(entryKey(path));
+    if (entry == m_entries.cend() || entry->isDirectory) return {};
+
+    const auto size = entry->size;
+    if (m_sectorSize == userDataSize)
+    {
+        const auto offset = static_cast<qint64>(entry->lba) * userDataSize;
+        if (offset + size > m_imageSize) return {};
+        return QByteArray::fromRawData(reinterpret_cast<const char*>(m_mapping + offset),
+                                       static_cast<int>(size));
+    }
+
+    QByteArray data(static_cast<int>(size), Qt::Uninitialized);
+    auto lba = entry->lba;
+    for (uint32_t copied = 0; copied < size; copied += userDataSize, lba++)
+    {
+        const auto* sector = userData(lba);
+        if (sector == nullptr) return {};
+        std::memcpy(data.data() + copied, sector, std::min(userDataSize, size - copied));
+    }
+    return data;
+}
+
+bool DiscImage::parseCue(const QString& cuePath)
+{
+    QFile cue(cuePath);
+    if (!cue.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        KFMTError::error(QStringLiteral("Couldn't open the CUE sheet %1.").arg(cuePath));
+        return false;
+    }
+
+    static const QRegularExpression fileLine(
+        QStringLiteral(R"(^\s*FILE\s+(?:"([^"]+)"|(\S+))\s+BINARY)"),
+        QRegularExpression::CaseInsensitiveOption);
+    static const QRegularExpression trackLine(QStringLiteral(R"(^\s*TRACK\s+\d+\s+MODE[12]/(\d+))"),
+                                              QRegularExpression::CaseInsensitiveOption);
+
+    // PS1 discs have their data track first, so only the first file and its first track matter.
+    m_hasTrailingTracks = false;
+    QString binName;
+    while (!cue.atEnd())
+    {
+        const auto line = QString::fromUtf8(cue.readLine());
+        if (binName.isEmpty())
+        {
+            const auto match = fileLine.match(line);
+            if (match.hasMatch())
+                binName = match.captured(1).isEmpty() ? match.captured(2) : match.captured(1);
+            continue;
+        }
+
+        const auto match = trackLine.match(line);
+        if (!match.hasMatch()) continue;
+
+        m_sectorSize = match.captured(1).toUInt();
+        if (m_sectorSize != rawSectorSize && m_sectorSize != userDataSize) break;
+        m_imagePath = QFileInfo(cuePath).dir().filePath(binName);
+
+        // Audio tracks right after the data track in the same file mean there's no free space
+        // after the volume.
+        static const QRegularExpression anyTrackLine(QStringLiteral(R"(^\s*(TRACK|FILE)\s)"),
+                                                     QRegularExpression::CaseInsensitiveOption);
+        while (!cue.atEnd())
+        {
+            const auto nextMatch = anyTrackLine.match(QString::fromUtf8(cue.readLine()));
+            if (!nextMatch.hasMatch()) continue;
+            m_hasTrailingTracks = nextMatch.captured(1).compare(QStringLiteral("TRACK"),
+                                                                Qt::CaseInsensitive)
+                                  == 0;
+            break;
+        }
+        return true;
+    }
+
+    KFMTError::error(QStringLiteral("%1 doesn't have a data track.").arg(cuePath));
+    return false;
+}
+
+bool DiscImage::readDirectory(const Extent& directory, const QString& prefix, const int depth)
+{
+    if (depth > maxDirectoryDepth)
+    {
+        KFMTError::error(QStringLiteral("%1 has directories nested too deep.").arg(m_imagePath));
+        return false;
+    }
+
+    for (uint32_t offset = 0; offset < directory.size;)
+    {
+        const auto sectorOffset = offset % userDataSize;
+        const auto sectorLba = directory.lba + offset / userDataSize;
+        const auto* sector = userData(sectorLba);
+        if (sector == nullptr)
+        {
+            KFMTError::error(QStringLiteral("%1 is truncated.").arg(m_imagePath));
+            return false;
+        }
+
+        // Records never cross sectors, so a zero length means the rest of the sector is padding.
+        const auto* record = sector + sectorOffset;
+        const uint32_t length = record[0];
+        if (length == 0)
+        {
+            offset += userDataSize - sectorOffset;
+            continue;
+        }
+
+        const uint32_t nameLength = record[32];
+        if (length < 34 || sectorOffset + length > userDataSize || 33 + nameLength > length)
+        {
+            KFMTError::error(QStringLiteral("%1 has a broken directory record.").arg(m_imagePath));
+            return false;
+        }
+        offset += length;
+
+        // Skip the records for the directory itself and its parent.
+        if (nameLength == 1 && record[33] <= 1) continue;
+
+        const Extent entry {qFromLittleEndian<quint32>(record + 2),
+                            qFromLittleEndian<quint32>(record + 10),
+                            (record[25] & 0x02) != 0,
+                            sectorLba,
+                            sectorOffset};
+        auto name = QString::fromLatin1(reinterpret_cast<const char*>(record + 33),
+                                        static_cast<int>(nameLength))
+                        .toUpper();
+        // Drop the version number ("FDAT.T;1") and the dot some tools leave on names with no
+        // extension.
+        const auto versionStart = name.indexOf(QLatin1Char(';'));
+        if (versionStart != -1) name.truncate(versionStart);
+        if (name.endsWith(QLatin1Char('.'))) name.chop(1);
+
+        const auto path = prefix + name;
+        m_entries.insert(path, entry);
+        if (entry.isDirectory && !readDirectory(entry, path + QLatin1Char('/'), depth + 1))
+            return false;
+    }
+
+    return true;
+}
+
+const uint8_t* DiscImage::userData(const uint32_t lba) const
+{
+    const auto offset = static_cast<qint64>(lba) * m_sectorSize + m_userDataOffset;
+    if (offset + userDataSize > m_imageSize) return nullptr;
+    return m_mapping + offset;
+}
+
+bool DiscImage::writeFile(const QString& path, const QByteArray& data)
+{
+    const auto entry = m_entries.find(entryKey(path));
+    if (entry == m_entries.end() || entry->isDirectory)
+    {
+        KFMTError::error(QStringLiteral("%1 isn't a file in %2.").arg(path, m_imagePath));
+        return false;
+    }
+
+    if (!m_writer.isOpen())
+    {
+        m_writer.setFileName(m_imagePath);
+        if (!m_writer.open(QIODevice::ReadWrite))
+        {
+            KFMTError::error(QStringLiteral("Couldn't open %1 for writing: %2")
+                                 .arg(m_imagePath, m_writer.errorString()));
+            return false;
+        }
+    }
+
+    const auto size = static_cast<uint32_t>(data.size());
+    const auto sectors = (size + userDataSize - 1) / userDataSize;
+    auto lba = entry->lba;
+    if (sectors > (entry->size + userDataSize - 1) / userDataSize)
+    {
+        lba = findFreeSectors(sectors);
+        if (lba == 0)
+        {
+            KFMTError::error(QStringLiteral("%1 doesn't fit where it was anymore, and %2 has no "
+                                            "free space left for it.").arg(path, m_imagePath));
+            return false;
+        }
+    }
+
+    // The data goes first, so the directory record never points to sectors that weren't written.
+    std::array<uint8_t, userDataSize> sector {};
+    for (uint32_t sectorNo = 0; sectorNo < sectors; sectorNo++)
+    {
+        const auto offset = sectorNo * userDataSize;
+        const auto chunk = std::min(userDataSize, size - offset);
+        std::memcpy(sector.data(), data.constData() + offset, chunk);
+        std::memset(sector.data() + chunk, 0, userDataSize - chunk);
+        // Data sectors of a file are all flagged as data, and the last one also ends the file.
+        const int submode = sectorNo + 1 == sectors ? 0x89 : 0x08;
+        if (!writeUserData(lba + sectorNo, sector.data(), submode)) return false;
+    }
+
+    if (lba + sectors > m_volumeSectors)
+    {
+        if (!writeBothEndian(pvdSector, 80, lba + sectors)) return false;
+        m_volumeSectors = lba + sectors;
+    }
+    if (lba != entry->lba && !writeBothEndian(entry->recordLba, entry->recordOffset + 2, lba))
+        return false;
+    if (size != entry->size && !writeBothEndian(entry->recordLba, entry->recordOffset + 10, size))
+        return false;
+
+    entry->lba = lba;
+    entry->size = size;
+    return m_writer.flush();
+}
+
+uint32_t DiscImage::findFreeSectors(const uint32_t count) const
+{
+    const auto extentEnd = [](const Extent& extent) {
+        return extent.lba + std::max(1u, (extent.size + userDataSize - 1) / userDataSize);
+    };
+
+    // The system area and the volume descriptors, up to the set terminator.
+    std::vector<std::pair<uint32_t, uint32_t>> used;
+    auto descriptor = pvdSector;
+    for (const uint8_t* data; (data = userData(descriptor)) != nullptr && data[0] != 0xFF;)
+        descriptor++;
+    used.emplace_back(0, descriptor + 1);
+
+    // Path tables, in both byte orders.
+    const auto* pvd = userData(pvdSector);
+    const auto pathTableSectors = (qFromLittleEndian<quint32>(pvd + 132) + userDataSize - 1)
+                                  / userDataSize;
+    for (const auto pathTable : {qFromLittleEndian<quint32>(pvd + 140),
+                                 qFromLittleEndian<quint32>(pvd + 144),
+                                 qFromBigEndian<quint32>(pvd + 148),
+                                 qFromBigEndian<quint32>(pvd + 152)})
+    {
+        if (pathTable != 0) used.emplace_back(pathTable, pathTable + pathTableSectors);
+    }
+
+    used.emplace_back(m_root.lba, extentEnd(m_root));
+    for (const auto& entry : m_entries)
+        used.emplace_back(entry.lba, extentEnd(entry));
+    std::sort(used.begin(), used.end());
+
+    uint32_t candidate = 0;
+    for (const auto& [first, end] : used)
+    {
+        if (first >= candidate + count) break;
+        candidate = std::max(candidate, end);
+    }
+
+    return candidate + count <= m_trackSectors ? candidate : 0;
+}
+
+bool DiscImage::writeUserData(const uint32_t lba, const uint8_t* data, const int submode)
+{
+    const auto write = [this](qint64 offset, const uint8_t* bytes, qint64 size) {
+        if (m_writer.seek(offset)
+            && m_writer.write(reinterpret_cast<const char*>(bytes), size) == size)
+            return true;
+
+        KFMTError::error(QStringLiteral("Couldn't write to %1: %2")
+                             .arg(m_imagePath, m_writer.errorString()));
+        return false;
+    };
+
+    const auto offset = static_cast<qint64>(lba) * m_sectorSize;
+    if (offset + m_sectorSize > m_imageSize)
+    {
+        KFMTError::error(QStringLiteral("Tried writing past the end of %1.").arg(m_imagePath));
+        return false;
+    }
+    const auto* current = m_mapping + offset;
+
+    if (m_sectorSize == userDataSize)
+    {
+        if (std::memcmp(current, data, userDataSize) == 0) return true;
+        return write(offset, data, userDataSize);
+    }
+
+    // The header is rebuilt since relocated files can land on sectors that never had one.
+    std::array<uint8_t, rawSectorSize> sector;
+    std::memcpy(sector.data(), current, rawSectorSize);
+    std::memcpy(sector.data(), syncPattern, sizeof(syncPattern));
+    // Addresses are BCD minutes, seconds and frames, and the data starts at 2 seconds.
+    const auto address = lba + 150;
+    sector[12] = toBcd(address / 75 / 60);
+    sector[13] = toBcd(address / 75 % 60);
+    sector[14] = toBcd(address % 75);
+    sector[15] = m_userDataOffset == 24 ? 2 : 1;
+    if (sector[15] == 2 && submode >= 0)
+    {
+        // The subheader is stored twice. File and channel numbers are kept as they were.
+        sector[18] = sector[22] = static_cast<uint8_t>(submode);
+        sector[19] = sector[23] = 0;
+    }
+    std::memcpy(sector.data() + m_userDataOffset, data, userDataSize);
+
+    // EDC and ECC only depend on what comes before them, so unchanged sectors can be skipped.
+    if (std::memcmp(sector.data(), current, m_userDataOffset + userDataSize) == 0) return true;
+
+    generateEdcEcc(sector.data());
+    return write(offset, sector.data(), rawSectorSize);
+}
+
+bool DiscImage::writeBothEndian(const uint32_t lba, const uint32_t offset, const uint32_t value)
+{
+    const auto* current = userData(lba);
+    if (current == nullptr) return false;
+
+    std::array<uint8_t, userDataSize> sector;
+    std::memcpy(sector.data(), current, userDataSize);
+    qToLittleEndian<quint32>(value, sector.data() + offset);
+    qToBigEndian<quint32>(value, sector.data() + offset + 4);
+    return writeUserData(lba, sector.data(), -1);
+}
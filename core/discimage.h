@@ -0,0 +1,118 @@
+#ifndef DISCIMAGE_H
+#define DISCIMAGE_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QHash>
+#include <QString>
+
+/*!
+ * \brief Access to the files of a PS1 disc image, without extracting it.
+ * Supports CUE sheets (for the first data track), raw BIN images with 2352-byte sectors (Mode 1 or
+ * Mode 2 Form 1) and plain ISO images with 2048-byte sectors. The image is memory mapped and its
+ * ISO9660 directory tree is read once when opening it. Files can be patched back into it.
+ */
+class DiscImage
+{
+public:
+    /*!
+     * \brief Opens an image and reads its directory tree.
+     * \param path Path to a .cue, .bin or .iso file.
+     * \return Whether the image could be opened. Errors are reported through KFMTError.
+     */
+    bool open(const QString& path);
+
+    /*!
+     * \brief Whether a file or directory exists in the image.
+     * \param path Path from the root of the disc, e.g. "CD/COM/FDAT.T". Case doesn't matter.
+     */
+    [[nodiscard]] bool exists(const QString& path) const;
+
+    /*!
+     * \brief Reads a file from the image.
+     * For ISO images this is a view into the mapping and doesn't copy anything, so the image has
+     * to outlive it. Raw images interleave sector headers with the data, so it's gathered into a
+     * copy instead.
+     * \return The file's data, or an empty array if it doesn't exist.
+     */
+    [[nodiscard]] QByteArray read(const QString& path) const;
+
+    /*!
+     * \brief Writes new contents for a file into the image.
+     * Files that still fit in their extent are overwritten in place. Otherwise they're moved to
+     * free space in the data track and their directory record is updated. Only sectors whose
+     * contents change are written, and raw sectors get their EDC/ECC regenerated.
+     * Views from read() into the image see the new contents of the sectors they cover.
+     * \return Whether the file was written. Errors are reported through KFMTError.
+     */
+    bool writeFile(const QString& path, const QByteArray& data);
+
+    /*!
+     * \brief Gets the path of the image data (the BIN file for CUE sheets).
+     */
+    [[nodiscard]] inline const QString& imagePath() const { return m_imagePath; }
+
+    static constexpr uint32_t userDataSize = 2048;
+
+private:
+    /*!
+     * \brief Location of a file or directory in the image.
+     */
+    struct Extent
+    {
+        uint32_t lba;
+        uint32_t size;
+        bool isDirectory;
+        uint32_t recordLba = 0;    ///< Sector of the directory record describing this.
+        uint32_t recordOffset = 0; ///< Offset of that record in its sector.
+    };
+
+    bool parseCue(const QString& cuePath);
+    bool readDirectory(const Extent& directory, const QString& prefix, int depth);
+    /*!
+     * \brief Finds a run of sectors no file, directory or descriptor uses.
+     * \return First sector of the run, or 0 if there's no run that long.
+     */
+    [[nodiscard]] uint32_t findFreeSectors(uint32_t count) const;
+    /*!
+     * \brief Writes the user data of a sector, if it changes anything.
+     * \param submode Mode 2 submode to write, or -1 to keep the sector's subheader.
+     */
+    bool writeUserData(uint32_t lba, const uint8_t* data, int submode);
+    /*!
+     * \brief Writes a value to an ISO9660 both-endian field (little-endian, then big-endian).
+     */
+    bool writeBothEndian(uint32_t lba, uint32_t offset, uint32_t value);
+    /*!
+     * \brief Gets the user data of a sector, or nullptr if it's past the end of the image.
+     */
+    [[nodiscard]] const uint8_t* userData(uint32_t lba) const;
+
+    QString m_imagePath;
+    QFile m_image;
+    const uint8_t* m_mapping = nullptr;
+    qint64 m_imageSize = 0;
+    uint32_t m_sectorSize = userDataSize;
+    uint32_t m_userDataOffset = 0;
+    /*!
+     * \brief Sector count the volume descriptor declares.
+     */
+    uint32_t m_volumeSectors = 0;
+    /*!
+     * \brief Sectors in the image that belong to the data track.
+     * Sectors past m_volumeSectors are free to use for relocated files.
+     */
+    uint32_t m_trackSectors = 0;
+    /*!
+     * \brief Whether the CUE sheet has more tracks in the same file after the data track.
+     */
+    bool m_hasTrailingTracks = false;
+    Extent m_root {};
+    QHash<QString, Extent> m_entries;
+    /*!
+     * \brief Handle writes go through. The mapping stays read-only.
+     */
+    QFile m_writer;
+};
+
+#endif // DISCIMAGE_H
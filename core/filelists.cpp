@@ -0,0 +1,68 @@
+#include "filelists.h"
+#include "kfmterror.h"
+
+namespace
+{
+// The included files are generated by qmake from filelists/*.csv.
+constexpr FileLists::Source kf1Csv = {
+#include "filelist_kf1.inc"
+};
+constexpr FileLists::Source kf2CdCsv = {
+#include "filelist_kf2_cd.inc"
+};
+constexpr FileLists::Source kf2GameExeCsv = {
+#include "filelist_kf2_gameexe.inc"
+};
+constexpr FileLists::Source kf2OpECsv = {
+#include "filelist_kf2_op_e.inc"
+};
+constexpr FileLists::Source kf2OpJCsv = {
+#include "filelist_kf2_op_j.inc"
+};
+constexpr FileLists::Source kf2OpUCsv = {
+#include "filelist_kf2_op_u.inc"
+};
+
+constexpr auto kf1 = FileLists::parse<kf1Csv.lineCount>(kf1Csv.csv);
+constexpr auto kf2Cd = FileLists::parse<kf2CdCsv.lineCount>(kf2CdCsv.csv);
+constexpr auto kf2GameExe = FileLists::parse<kf2GameExeCsv.lineCount>(kf2GameExeCsv.csv);
+constexpr auto kf2OpE = FileLists::parse<kf2OpECsv.lineCount>(kf2OpECsv.csv);
+constexpr auto kf2OpJ = FileLists::parse<kf2OpJCsv.lineCount>(kf2OpJCsv.csv);
+constexpr auto kf2OpU = FileLists::parse<kf2OpUCsv.lineCount>(kf2OpUCsv.csv);
+
+template<size_t N>
+constexpr FileLists::Table table(const FileLists::BuiltInTable<N>& builtIn)
+{
+    return {builtIn.entries.data(), builtIn.count};
+}
+} // namespace
+
+void FileLists::invalidFileList(std::u16string_view reason, std::u16string_view value)
+{
+    KFMTError::fatalError(QStringLiteral("Invalid file list: %1 %2")
+                              .arg(QString::fromUtf16(reason.data(), static_cast<int>(reason.size())),
+                                   QString::fromUtf16(value.data(), static_cast<int>(value.size()))));
+}
+
+std::optional<FileLists::Error> FileLists::parse(std::u16string_view csv,
+                                                 std::vector<Entry>& entries)
+{
+    entries.clear();
+    const auto error = forEachEntry(csv, [&entries](size_t, const Entry& entry) {
+        entries.push_back(entry);
+    });
+    if (error) entries.clear();
+    return error;
+}
+
+FileLists::Table FileLists::builtIn(std::u16string_view name)
+{
+    if (name == u"kf1.csv") return table(kf1);
+    if (name == u"kf2_cd.csv") return table(kf2Cd);
+    if (name == u"kf2_gameexe.csv") return table(kf2GameExe);
+    if (name == u"kf2_op_e.csv") return table(kf2OpE);
+    if (name == u"kf2_op_j.csv") return table(kf2OpJ);
+    if (name == u"kf2_op_u.csv") return table(kf2OpU);
+
+    return {};
+}
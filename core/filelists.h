@@ -0,0 +1,221 @@
+#ifndef FILELISTS_H
+#define FILELISTS_H
+
+#include "core/kfmtfile.h"
+#include <array>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+/*!
+ * \brief File lists (the CSVs in the filelists folder) compiled into tables.
+ * The CSVs are still the source of truth: qmake wraps each of them into a raw string literal
+ * along with its line count (filelist_*.inc in the build directory), which is parsed here at
+ * compile time, so a broken file list is a build error and loading a game doesn't parse anything.
+ * The same parser is used at runtime for custom file lists, which report errors instead.
+ */
+namespace FileLists
+{
+
+/*!
+ * \brief Line of a file list.
+ * The strings are views into the file list, so it has to outlive anything made from them.
+ */
+struct Entry
+{
+    std::u16string_view path;
+    KFMTFile::FileFormat format = KFMTFile::FileFormat::Raw;
+    KFMTFile::DataType dataType = KFMTFile::DataType::Unknown;
+    std::u16string_view prettyName;
+};
+
+/*!
+ * \brief Non-owning range of file list entries.
+ */
+struct Table
+{
+    const Entry* entries = nullptr;
+    size_t count = 0;
+
+    constexpr const Entry* begin() const { return entries; }
+    constexpr const Entry* end() const { return entries + count; }
+};
+
+/*!
+ * \brief Why a file list couldn't be parsed.
+ */
+struct Error
+{
+    std::u16string_view reason;
+    std::u16string_view value; ///< The part of the file list that's wrong, if there's one.
+};
+
+/*!
+ * \brief A built-in file list as qmake generates it.
+ */
+struct Source
+{
+    size_t lineCount; ///< Lines in the CSV, which is at least how many files it has.
+    std::u16string_view csv;
+};
+
+/*!
+ * \brief Reports an invalid built-in file list.
+ * This isn't constexpr on purpose: reaching it while parsing a built-in file list fails the build.
+ */
+[[noreturn]] void invalidFileList(std::u16string_view reason, std::u16string_view value);
+
+/*!
+ * \brief Removes and returns everything before the next separator (or the end) from str.
+ */
+constexpr std::u16string_view takeUntil(std::u16string_view& str, char16_t separator)
+{
+    const auto end = str.find(separator);
+    auto result = str.substr(0, end);
+    str.remove_prefix(end == std::u16string_view::npos ? str.size() : end + 1);
+    return result;
+}
+
+constexpr std::u16string_view takeLine(std::u16string_view& csv)
+{
+    auto line = takeUntil(csv, u'\n');
+    if (!line.empty() && line.back() == u'\r') line.remove_suffix(1);
+    return line;
+}
+
+constexpr std::optional<KFMTFile::DataType> parseDataType(std::u16string_view str)
+{
+    // Generic
+    if (str == u"Container") return KFMTFile::DataType::Container;
+    if (str == u"GameDB") return KFMTFile::DataType::GameDB;
+    if (str == u"MapTile") return KFMTFile::DataType::MapTile;
+    if (str == u"MapTilemap") return KFMTFile::DataType::MapTilemap;
+    if (str == u"MapDB") return KFMTFile::DataType::MapDB;
+    if (str == u"MapScript") return KFMTFile::DataType::MapScript;
+    if (str == u"Model") return KFMTFile::DataType::Model;
+    if (str == u"MusicSequence") return KFMTFile::DataType::MusicSequence;
+    if (str == u"SoundBankBody") return KFMTFile::DataType::SoundBankBody;
+    if (str == u"SoundBankHeader") return KFMTFile::DataType::SoundBankHeader;
+    if (str == u"TextureDB") return KFMTFile::DataType::TextureDB;
+    if (str == u"Unknown") return KFMTFile::DataType::Unknown;
+
+    // KF1 specific
+    if (str == u"KF1_ArmourParams") return KFMTFile::DataType::KF1_ArmourParams;
+    if (str == u"KF1_LevelCurve") return KFMTFile::DataType::KF1_LevelCurve;
+    if (str == u"KF1_MagicParams") return KFMTFile::DataType::KF1_MagicParams;
+    if (str == u"KF1_WeaponParams") return KFMTFile::DataType::KF1_WeaponParams;
+
+    // KF2 specific
+    if (str == u"KF2_ArmourParams") return KFMTFile::DataType::KF2_ArmourParams;
+    if (str == u"KF2_GameExec") return KFMTFile::DataType::KF2_GameExec;
+    if (str == u"KF2_LevelCurve") return KFMTFile::DataType::KF2_LevelCurve;
+    if (str == u"KF2_MagicParams") return KFMTFile::DataType::KF2_MagicParams;
+    if (str == u"KF2_ModelPack_MO") return KFMTFile::DataType::KF2_ModelPack_MO;
+    if (str == u"KF2_ModelPack_TMD") return KFMTFile::DataType::KF2_ModelPack_TMD;
+    if (str == u"KF2_ObjectClasses") return KFMTFile::DataType::KF2_ObjectClasses;
+    if (str == u"KF2_SoundEffectParams") return KFMTFile::DataType::KF2_SoundEffectParams;
+    if (str == u"KF2_TileRenderParams") return KFMTFile::DataType::KF2_TileRenderParams;
+    if (str == u"KF2_WeaponParams") return KFMTFile::DataType::KF2_WeaponParams;
+
+    return std::nullopt;
+}
+
+constexpr std::optional<KFMTFile::FileFormat> parseFileFormat(std::u16string_view str)
+{
+    if (str == u"Folder") return KFMTFile::FileFormat::Folder;
+    if (str == u"MIMList") return KFMTFile::FileFormat::MIMList;
+    if (str == u"MIX") return KFMTFile::FileFormat::MIX;
+    if (str == u"Raw") return KFMTFile::FileFormat::Raw;
+    if (str == u"T") return KFMTFile::FileFormat::T;
+
+    return std::nullopt;
+}
+
+/*!
+ * \brief Checks a file list's header and calls onEntry for each of its files, in order.
+ * Parsing stops at the first error.
+ * \return Why the file list is invalid, or nothing if it's valid.
+ */
+template<class OnEntry>
+constexpr std::optional<Error> forEachEntry(std::u16string_view csv, OnEntry onEntry)
+{
+    // The generated literals start with a line break after the opening delimiter.
+    if (!csv.empty() && csv.front() == u'\n') csv.remove_prefix(1);
+
+    // Only the first four fields of the header count. Some file lists pad it to five.
+    auto header = takeLine(csv);
+    if (takeUntil(header, u',') != u"FSMTFileList" || takeUntil(header, u',') != u"v"
+        || takeUntil(header, u',') != u"0" || takeUntil(header, u',') != u"1")
+        return Error {u"Invalid version header", {}};
+    auto sectionLine = takeLine(csv);
+    if (takeUntil(sectionLine, u',') != u"FILES") return Error {u"Files section not found", {}};
+    // Skip FILES section header
+    takeLine(csv);
+
+    size_t count = 0;
+    while (!csv.empty())
+    {
+        auto line = takeLine(csv);
+        if (line.empty()) continue;
+
+        Entry entry;
+        entry.path = takeUntil(line, u',');
+        if (entry.path.empty()) return Error {u"Empty file path", {}};
+        const auto formatName = takeUntil(line, u',');
+        const auto format = parseFileFormat(formatName);
+        if (!format) return Error {u"Unknown file format", formatName};
+        entry.format = *format;
+        const auto dataTypeName = takeUntil(line, u',');
+        const auto dataType = parseDataType(dataTypeName);
+        if (!dataType) return Error {u"Unknown data type", dataTypeName};
+        entry.dataType = *dataType;
+        entry.prettyName = takeUntil(line, u',');
+
+        onEntry(count, entry);
+        count++;
+    }
+
+    return std::nullopt;
+}
+
+/*!
+ * \brief Entries of a built-in file list, parsed at compile time.
+ * There's room for an entry per line, since counting the entries would mean parsing it twice.
+ */
+template<size_t MaxCount>
+struct BuiltInTable
+{
+    std::array<Entry, MaxCount> entries {};
+    size_t count = 0;
+};
+
+template<size_t MaxCount>
+constexpr BuiltInTable<MaxCount> parse(std::u16string_view csv)
+{
+    BuiltInTable<MaxCount> table;
+    const auto error = forEachEntry(csv, [&table](size_t index, const Entry& entry) {
+        if (index >= MaxCount) invalidFileList(u"More files than lines", entry.path);
+        table.entries[index] = entry;
+        table.count = index + 1;
+    });
+    if (error) invalidFileList(error->reason, error->value);
+    return table;
+}
+
+/*!
+ * \brief Parses a file list at runtime.
+ * \param csv Contents of the file list, which must outlive the entries.
+ * \param entries Receives the entries. Left empty if the file list is invalid.
+ * \return Why the file list is invalid, or nothing if it's valid.
+ */
+std::optional<Error> parse(std::u16string_view csv, std::vector<Entry>& entries);
+
+/*!
+ * \brief Gets a built-in file list by its file name, e.g. "kf2_cd.csv".
+ * \return The file list, or an empty table if there's no built-in file list with that name.
+ */
+Table builtIn(std::u16string_view name);
+
+} // namespace FileLists
+
+#endif // FILELISTS_H
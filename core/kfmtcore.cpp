@@ -1,8 +1,15 @@
 #include "kfmtcore.h"
+#include "filelists.h"
 #include "kfmterror.h"
 #include "kfmtfile.h"
+#include "utilities.h"
 #include <QCryptographicHash>
-#include <QTextStream>
+#include <QBuffer>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QSettings>
+#include <QThread>
+#include <algorithm>
 
 // Declaring the global
 KFMTCore core;
@@ -44,28 +51,70 @@ KFMTCore::SimpleGame KFMTCore::currentGame() const
 
 void KFMTCore::loadFrom(const QDir& srcDir)
 {
-    detectGame(srcDir);
+    resetSources();
+    m_curSourceDirectory = srcDir;
+    load();
+}
+
+void KFMTCore::loadFromImage(const QString& imagePath)
+{
+    resetSources();
+    auto image = std::make_unique<DiscImage>();
+    if (!image->open(imagePath))
+    {
+        m_curGame = VersionedGame::None;
+        return;
+    }
+
+    m_discImage = std::move(image);
+    m_curSourceDirectory = QFileInfo(imagePath).absoluteDir();
+    load();
+}
+
+void KFMTCore::resetSources()
+{
     files.resetRoot();
+    // Only safe now that nothing in the tree points into the old mappings anymore.
+    m_mappedSources.clear();
+    m_discImage.reset();
+}
+
+bool KFMTCore::sourceExists(const QString& path) const
+{
+    return m_discImage ? m_discImage->exists(path) : m_curSourceDirectory.exists(path);
+}
+
+QByteArray KFMTCore::readWholeSource(const QString& path) const
+{
+    if (m_discImage) return m_discImage->read(path);
+
+    QFile file(m_curSourceDirectory.filePath(path));
+    if (!file.open(QIODevice::ReadOnly)) return {};
+    return file.readAll();
+}
+
+void KFMTCore::load()
+{
+    detectGame();
     if (m_curGame == VersionedGame::None) return;
 
-    std::vector<QString> fileLists;
+    std::vector<FileLists::Table> fileLists;
 
-    m_curSourceDirectory = srcDir;
     switch (m_curGame)
     {
-        case VersionedGame::KF: fileLists.emplace_back(QStringLiteral("kf1.csv")); break;
+        case VersionedGame::KF: fileLists.push_back(FileLists::builtIn(u"kf1.csv")); break;
         case VersionedGame::KF2Jv1_0: [[fallthrough]];
         case VersionedGame::KF2Jv1_7: [[fallthrough]];
         case VersionedGame::KF2Jv1_8A: [[fallthrough]];
         case VersionedGame::KF2Jv1_8B:
-            fileLists.emplace_back(QStringLiteral("kf2_cd.csv"));
-            fileLists.emplace_back(QStringLiteral("kf2_op_j.csv"));
-            fileLists.emplace_back(QStringLiteral("kf2_gameexe.csv"));
+            fileLists.push_back(FileLists::builtIn(u"kf2_cd.csv"));
+            fileLists.push_back(FileLists::builtIn(u"kf2_op_j.csv"));
+            fileLists.push_back(FileLists::builtIn(u"kf2_gameexe.csv"));
             break;
         case VersionedGame::KF2U:
-            fileLists.emplace_back(QStringLiteral("kf2_cd.csv"));
-            fileLists.emplace_back(QStringLiteral("kf2_op_u.csv"));
-            fileLists.emplace_back(QStringLiteral("kf2_gameexe.csv"));
+            fileLists.push_back(FileLists::builtIn(u"kf2_cd.csv"));
+            fileLists.push_back(FileLists::builtIn(u"kf2_op_u.csv"));
+            fileLists.push_back(FileLists::builtIn(u"kf2_gameexe.csv"));
             break;
         default:
             KFMTError::error(QStringLiteral("KFMTCore::loadFrom: Unhandled Game value %1")
@@ -78,109 +127,117 @@ void KFMTCore::loadFrom(const QDir& srcDir)
         && m_curGame != VersionedGame::KF2U)
         KFMTError::warning(QStringLiteral("Support for the game you loaded is INCOMPLETE. Things "
                                           "will be broken, and names will be incorrect."));
-    
-    for (const auto& fileList : fileLists)
-        loadFileList(fileList);
-}
 
-KFMTFile::DataType KFMTCore::parseDataType(const QString& dataTypeStr)
-{
-    // Generic
-    if (dataTypeStr == QStringLiteral(u"Container")) return KFMTFile::DataType::Container;
-    if (dataTypeStr == QStringLiteral(u"GameDB")) return KFMTFile::DataType::GameDB;
-    if (dataTypeStr == QStringLiteral(u"MapTile")) return KFMTFile::DataType::MapTile;
-    if (dataTypeStr == QStringLiteral(u"MapTilemap")) return KFMTFile::DataType::MapTilemap;
-    if (dataTypeStr == QStringLiteral(u"MapDB")) return KFMTFile::DataType::MapDB;
-    if (dataTypeStr == QStringLiteral(u"MapScript")) return KFMTFile::DataType::MapScript;
-    if (dataTypeStr == QStringLiteral(u"Model")) return KFMTFile::DataType::Model;
-    if (dataTypeStr == QStringLiteral(u"MusicSequence")) return KFMTFile::DataType::MusicSequence;
-    if (dataTypeStr == QStringLiteral(u"SoundBankBody")) return KFMTFile::DataType::SoundBankBody;
-    if (dataTypeStr == QStringLiteral(u"SoundBankHeader"))
-        return KFMTFile::DataType::SoundBankHeader;
-    if (dataTypeStr == QStringLiteral(u"TextureDB")) return KFMTFile::DataType::TextureDB;
-    if (dataTypeStr == QStringLiteral(u"Unknown")) return KFMTFile::DataType::Unknown;
-
-    // KF1 specific
-    if (dataTypeStr == QStringLiteral(u"KF1_ArmourParams"))
-        return KFMTFile::DataType::KF1_ArmourParams;
-    if (dataTypeStr == QStringLiteral("KF1_LevelCurve")) return KFMTFile::DataType::KF1_LevelCurve;
-    if (dataTypeStr == QStringLiteral(u"KF1_MagicParams"))
-        return KFMTFile::DataType::KF1_MagicParams;
-    if (dataTypeStr == QStringLiteral(u"KF1_WeaponParams"))
-        return KFMTFile::DataType::KF1_WeaponParams;
-
-    // KF2 specific
-    if (dataTypeStr == QStringLiteral(u"KF2_ArmourParams"))
-        return KFMTFile::DataType::KF2_ArmourParams;
-    if (dataTypeStr == QStringLiteral(u"KF2_GameExec")) return KFMTFile::DataType::KF2_GameExec;
-    if (dataTypeStr == QStringLiteral(u"KF2_LevelCurve")) return KFMTFile::DataType::KF2_LevelCurve;
-    if (dataTypeStr == QStringLiteral(u"KF2_MagicParams"))
-        return KFMTFile::DataType::KF2_MagicParams;
-    if (dataTypeStr == QStringLiteral(u"KF2_ModelPack_MO")) return KFMTFile::DataType::KF2_ModelPack_MO;
-    if (dataTypeStr == QStringLiteral(u"KF2_ModelPack_TMD")) return KFMTFile::DataType::KF2_ModelPack_TMD;
-    if (dataTypeStr == QStringLiteral(u"KF2_ObjectClasses"))
-        return KFMTFile::DataType::KF2_ObjectClasses;
-    if (dataTypeStr == QStringLiteral(u"KF2_SoundEffectParams"))
-        return KFMTFile::DataType::KF2_SoundEffectParams;
-    if (dataTypeStr == QStringLiteral(u"KF2_TileRenderParams"))
-        return KFMTFile::DataType::KF2_TileRenderParams;
-    if (dataTypeStr == QStringLiteral(u"KF2_WeaponParams"))
-        return KFMTFile::DataType::KF2_WeaponParams;
-
-    fsmt_assert(false, "KFMTCore::parseDataType: File had unknown data type.");
-}
-
-KFMTFile::FileFormat KFMTCore::parseFileFormat(const QString& fileTypeStr)
-{
-    if (fileTypeStr == QStringLiteral("Folder")) return KFMTFile::FileFormat::Folder;
-    else if (fileTypeStr == QStringLiteral("MIX")) return KFMTFile::FileFormat::MIX;
-    else if (fileTypeStr == QStringLiteral("Raw")) return KFMTFile::FileFormat::Raw;
-    else if (fileTypeStr == QStringLiteral("T")) return KFMTFile::FileFormat::T;
+    // A custom file list replaces the built-in ones entirely.
+    m_customFileListEntries.clear();
+    m_customFileListData.clear();
+    if (!m_customFileListPath.isEmpty())
+    {
+        QFile customFileList(m_customFileListPath);
+        if (customFileList.open(QIODevice::ReadOnly | QIODevice::Text))
+        {
+            m_customFileListData = QString::fromUtf8(customFileList.readAll());
+            const auto error = FileLists::parse(
+                std::u16string_view(reinterpret_cast<const char16_t*>(m_customFileListData.utf16()),
+                                    static_cast<size_t>(m_customFileListData.size())),
+                m_customFileListEntries);
+            if (!error)
+                fileLists = {{m_customFileListEntries.data(), m_customFileListEntries.size()}};
+            else
+            {
+                const auto toQString = [](std::u16string_view str) {
+                    return QString::fromUtf16(str.data(), static_cast<int>(str.size()));
+                };
+                KFMTError::error(QStringLiteral("The custom file list %1 is invalid (%2 %3), using "
+                                                "the built-in ones instead.")
+                                     .arg(m_customFileListPath, toQString(error->reason),
+                                          toQString(error->value)));
+            }
+        }
+        else
+            KFMTError::error(QStringLiteral("Couldn't open the custom file list %1, using the "
+                                            "built-in ones instead.").arg(m_customFileListPath));
+    }
 
-    fsmt_assert(false, "KFMTCore::parseFileFormat: File had unknown file format.");
-}
+    QElapsedTimer loadTimer;
+    loadTimer.start();
 
-void KFMTCore::loadFileList(const QString& fileList)
-{
-    QFile listFile(":/filelists/" + fileList);
-    listFile.open(QIODevice::ReadOnly | QIODevice::Text);
+    // The file lists only build the tree, in the same order as always. Reading the files they
+    // create (and splitting the containers they look into) is then done all at once on the pool.
+    std::vector<SourceRead> reads;
+    for (const auto& fileList : fileLists)
+        loadFileList(fileList, reads);
 
-    QTextStream listStream(&listFile);
-    QStringList line;
+    {
+        // Closed before it's rewritten below, which Windows wouldn't allow while it's mapped.
+        ProjectIndex index;
+        index.open(indexPath());
+        loadSources(reads, index);
+    }
+    verifyChecksums(reads);
 
-    line = listStream.readLine().split(',');
-    fsmt_assert(line[0] == "FSMTFileList", "KFMTCore::loadFileList: Invalid version header!");
-    fsmt_assert(line[1] == "v", "KFMTCore::loadFileList: Invalid version header!");
-    fsmt_assert(line[2] == "0", "KFMTCore::loadFileList: Invalid version header!");
-    fsmt_assert(line[3] == "1", "KFMTCore::loadFileList: Invalid version header!");
+    const auto indexed = std::count_if(reads.cbegin(), reads.cend(), [](const SourceRead& read) {
+        return read.indexNode != -1;
+    });
+    KFMTError::log(QStringLiteral("KFMTCore::loadFrom: Loaded %1 files (%2 from the index) in %3 "
+                                  "ms using %4 threads.")
+                       .arg(reads.size())
+                       .arg(indexed)
+                       .arg(loadTimer.elapsed())
+                       .arg(m_loadPool.maxThreadCount()));
 
-    line = listStream.readLine().split(',');
-    fsmt_assert(line[0] == "FILES", "KFMTCore::loadFileList: Files section not found in file list!");
+    if (indexed != static_cast<std::ptrdiff_t>(reads.size())) writeIndex(reads);
+}
 
-    // Skip FILES section header
-    line = listStream.readLine().split(',');
+void KFMTCore::setLoadThreadCount(int threadCount)
+{
+    if (threadCount <= 0) threadCount = QThread::idealThreadCount();
+    m_loadPool.setMaxThreadCount(threadCount);
+}
 
-    while (!listStream.atEnd())
+void KFMTCore::loadFileList(const FileLists::Table& fileList, std::vector<SourceRead>& reads)
+{
+    for (const auto& entry : fileList)
     {
-        line = listStream.readLine().split(',');
-        auto path = line[0].split('/');
-        fsmt_assert(path.size() > 0, "KFMTCore::loadFileList: Empty file path found!");
+        // Both built-in and custom file lists outlive the tree, so names can point into them.
+        const auto fullPath = QStringView(entry.path.data(), static_cast<qsizetype>(entry.path.size()));
+        const auto name = fullPath.mid(fullPath.lastIndexOf(QLatin1Char('/')) + 1);
+        const auto prettyName = QString::fromRawData(reinterpret_cast<const QChar*>(
+                                                         entry.prettyName.data()),
+                                                     static_cast<int>(entry.prettyName.size()));
 
         KFMTFile* parent = &files;
         // If we're not in the root, dive to find the parent KFMTFile's child vector.
-        if (path.size() > 1)
+        // We stop at containers that haven't been split yet so we don't split them just to apply
+        // this line. The rest of the path is deferred to them and applied once they are split.
+        qsizetype levelStart = 0;
+        for (auto levelEnd = fullPath.indexOf(QLatin1Char('/'));
+             levelEnd != -1 && parent != nullptr && parent->isExpanded();
+             levelEnd = fullPath.indexOf(QLatin1Char('/'), levelStart))
         {
-            for (auto i = 0; i < path.size() - 1; i++)
-            {
-                parent = (*parent)[path[i]];
-                fsmt_assert(parent != nullptr, "KFMTCore::loadFileList: Couldn't find file parent!");
-            }
+            parent = (*parent)[fullPath.mid(levelStart, levelEnd - levelStart)];
+            levelStart = levelEnd + 1;
+        }
+
+        // Custom file lists can have files in folders or containers they don't have.
+        if (parent == nullptr)
+        {
+            KFMTError::log(QStringLiteral("KFMTCore::loadFileList: The folder or container %1 is in "
+                                          "isn't in the file list, skipping it.").arg(fullPath));
+            continue;
+        }
+
+        if (!parent->isExpanded())
+        {
+            parent->m_deferredEntries.push_back(
+                {fullPath.mid(levelStart), entry.format, entry.dataType, prettyName});
+            continue;
         }
 
         // Special case for folders
-        if (parseFileFormat(line[1]) == KFMTFile::FileFormat::Folder)
+        if (entry.format == KFMTFile::FileFormat::Folder)
         {
-            parent->createChild(path.back(),
+            parent->createChild(QString::fromRawData(name.data(), static_cast<int>(name.size())),
                                 QByteArray(),
                                 KFMTFile::FileFormat::Folder,
                                 KFMTFile::DataType::Container);
@@ -190,80 +247,633 @@ void KFMTCore::loadFileList(const QString& fileList)
         // Check if there is a "sibling" with this name...
         KFMTFile* sameName = nullptr;
         // As long as we're not in the root, that is!
-        if (path.size() > 1) sameName = (*parent)[path.last()];
+        if (parent != &files) sameName = (*parent)[name];
         // If there is one, just apply the properties in this line to it.
         if (sameName != nullptr)
         {
-            sameName->setFileFormat(parseFileFormat(line[1]));
-            sameName->setDataType(parseDataType(line[2]));
-            sameName->setPrettyName(line[3]);
-            //KFMTError::log(QStringLiteral("Loaded %1.").arg(line[0]));
+            sameName->setFileFormat(entry.format);
+            sameName->setDataType(entry.dataType);
+            sameName->setPrettyName(prettyName);
             continue;
         }
 
-        // If there is no child with this name, create one.
-        QFile file(m_curSourceDirectory.filePath(line[0]));
-        file.open(QIODevice::ReadOnly);
-        parent->createChild(path.back(),
-                            file.readAll(),
-                            parseFileFormat(line[1]),
-                            parseDataType(line[2]),
-                            line[3]);
-        file.close();
-        
-        //KFMTError::log(QStringLiteral("Loaded %1.").arg(line[0]));
+        // If there is no child with this name, create one. Its data is read later by loadSources.
+        parent->createChild(QString::fromRawData(name.data(), static_cast<int>(name.size())),
+                            QByteArray(),
+                            entry.format,
+                            entry.dataType,
+                            prettyName);
+        reads.push_back({parent->m_subFiles.back().get(),
+                         QString::fromRawData(fullPath.data(), static_cast<int>(fullPath.size())),
+                         nullptr});
+    }
+}
+
+QString KFMTCore::indexPath() const
+{
+    if (m_discImage) return m_discImage->imagePath() + QStringLiteral(".fsmtindex");
+    return m_curSourceDirectory.filePath(QStringLiteral(".fsmtindex"));
+}
+
+void KFMTCore::loadSources(std::vector<SourceRead>& reads, const ProjectIndex& index)
+{
+    // Handles are all created here so the workers never touch m_mappedSources. Disc images are
+    // already mapped as a whole, and their files change whenever the image does.
+    const QFileInfo imageInfo(m_discImage ? m_discImage->imagePath() : QString());
+    for (auto& read : reads)
+    {
+        const auto info = m_discImage ? imageInfo
+                                      : QFileInfo(m_curSourceDirectory.filePath(read.path));
+        if (info.exists())
+        {
+            read.size = info.size();
+            read.modified = info.lastModified().toMSecsSinceEpoch();
+            read.indexNode = index.findSource(read.path, read.size, read.modified);
+        }
+        if (!m_discImage)
+            read.source = &m_mappedSources.emplace_back(m_curSourceDirectory.filePath(read.path));
+    }
+
+    // Files read into their own buffers are interned by content hash, so identical source files
+    // share one buffer until one of them is written to. Mapped files cost no memory to begin with.
+    std::unordered_map<uint64_t, QByteArray> internedData;
+    std::mutex internMutex;
+
+    // Every read goes into its own file, and containers only create children under themselves,
+    // so the tasks only share the interned buffers. Files in disc images that aren't split here
+    // are only read once something uses them, see KFMTFile::loadData. That's a view of the mapping
+    // for ISO images, but raw images have to gather it out of their sectors into a copy, which
+    // containers have to be anyway. The benchmarks time DiscImage::read for both kinds of image.
+    for (auto& read : reads)
+    {
+        m_loadPool.start([this, &read, &index]() {
+            if (m_discImage && read.file->m_deferredEntries.empty()
+                && !KFMTFile::isSplitFormat(read.file->format()))
+            {
+                read.file->deferData([image = m_discImage.get(), path = read.path]() {
+                    return image->read(path);
+                });
+                if (read.indexNode != -1)
+                    index.restore(*read.file, static_cast<uint32_t>(read.indexNode));
+                return;
+            }
+
+            auto data = m_discImage ? m_discImage->read(read.path)
+                                    : readSourceFile(*read.source, read.path);
+            // This has to happen before anything is split out of the file, since its children
+            // are views into whichever buffer it ends up with.
+            std::optional<uint64_t> hash;
+            if (!m_discImage && !read.source->isOpen() && !data.isEmpty())
+            {
+                hash = Utilities::contentHash(data);
+                std::lock_guard lock(internMutex);
+                const auto [interned, added] = internedData.try_emplace(*hash, data);
+                if (!added && interned->second == data) data = interned->second;
+            }
+            read.file->setLoadedData(data, hash);
+
+            // Indexed files get their splits from the index, so their data isn't read. Files are
+            // only hashed once something needs it, see KFMTFile::contentHash.
+            if (read.indexNode != -1)
+                index.restore(*read.file, static_cast<uint32_t>(read.indexNode));
+
+            // Containers the file lists look into are going to be split anyway as soon as
+            // something looks for those files, so we may as well do it here. T files are split
+            // too, so their checksums can be verified. Files the index split are already done,
+            // while the index is out of date for any other file that has to be split here.
+            if (!read.file->m_deferredEntries.empty()
+                || read.file->format() == KFMTFile::FileFormat::T)
+            {
+                if (!read.file->isExpanded()) read.indexNode = -1;
+                read.file->expand();
+            }
+        });
     }
+    m_loadPool.waitForDone();
+
+    // Handles for files that were read instead of mapped are closed and no longer needed.
+    m_mappedSources.remove_if([](const QFile& file) { return !file.isOpen(); });
+}
+
+void KFMTCore::verifyChecksums(const std::vector<SourceRead>& reads)
+{
+    QElapsedTimer verifyTimer;
+    verifyTimer.start();
+
+    std::vector<KFMTFile*> subFiles;
+    for (const auto& read : reads)
+    {
+        // Bad checksums of indexed files were recorded in the index.
+        if (read.file->format() != KFMTFile::FileFormat::T || read.indexNode != -1) continue;
+        for (const auto& subFile : read.file->m_subFiles)
+            subFiles.push_back(subFile.get());
+    }
+
+    // Subfile sizes are all over the place, so they're handed out in small batches instead of
+    // splitting them evenly between the threads.
+    static constexpr size_t batchSize = 64;
+    for (size_t first = 0; first < subFiles.size(); first += batchSize)
+    {
+        m_loadPool.start([&subFiles, first]() {
+            const auto last = std::min(first + batchSize, subFiles.size());
+            for (auto fileNo = first; fileNo < last; fileNo++)
+                subFiles[fileNo]->verifyChecksum();
+        });
+    }
+    m_loadPool.waitForDone();
+
+    const auto badChecksums = std::count_if(subFiles.cbegin(), subFiles.cend(),
+                                            [](const KFMTFile* file) {
+                                                return file->hasBadChecksum();
+                                            });
+    KFMTError::log(QStringLiteral("KFMTCore::verifyChecksums: %1 of %2 T file subfiles have bad "
+                                  "checksums. Verified in %3 ms.")
+                       .arg(badChecksums)
+                       .arg(subFiles.size())
+                       .arg(verifyTimer.elapsed()));
+}
+
+void KFMTCore::writeIndex(const std::vector<SourceRead>& reads)
+{
+    QElapsedTimer indexTimer;
+    indexTimer.start();
+
+    std::vector<ProjectIndex::SourceEntry> sources;
+    sources.reserve(reads.size());
+    for (const auto& read : reads)
+        sources.push_back({read.path, read.size, read.modified, read.file});
+
+    // The index is only a cache, so not being able to write it (e.g. next to a game on a read-only
+    // drive) just means the next load is a full one too.
+    if (ProjectIndex::write(indexPath(), sources))
+        KFMTError::log(QStringLiteral("KFMTCore::writeIndex: Wrote %1 in %2 ms.")
+                           .arg(indexPath())
+                           .arg(indexTimer.elapsed()));
+    else
+        KFMTError::log(QStringLiteral("KFMTCore::writeIndex: Couldn't write %1.").arg(indexPath()));
+}
+
+QByteArray KFMTCore::readSourceFile(QFile& file, const QString& path)
+{
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        KFMTError::log(QStringLiteral("KFMTCore::readSourceFile: Couldn't open %1.").arg(path));
+        return {};
+    }
+
+    if (m_loadMode == LoadMode::MemoryMapped && file.size() > 0)
+    {
+        // The mapping is read-only, but QByteArray never writes to raw data it doesn't own: the
+        // first non-const access (i.e. an editor writing to the file) detaches it into a copy.
+        const auto* mapping = file.map(0, file.size());
+        if (mapping != nullptr)
+            return QByteArray::fromRawData(reinterpret_cast<const char*>(mapping),
+                                           static_cast<int>(file.size()));
+
+        KFMTError::log(QStringLiteral("KFMTCore::readSourceFile: Couldn't map %1, reading it "
+                                      "instead.").arg(path));
+    }
+
+    auto data = file.readAll();
+    file.close();
+    return data;
 }
 
 void KFMTCore::saveTo(const QDir& outDir)
 {
-    // FIXME: REIMPLEMENT THIS URGENTLYYY!!!
-    KFMTError::error(QStringLiteral(u"Saving has not been reimplemented yet."));
+    if (m_curGame == VersionedGame::None) return;
+
+    QElapsedTimer saveTimer;
+    saveTimer.start();
+
+    const bool inPlace = !m_discImage && outDir == m_curSourceDirectory;
+    files.clearUnchanged();
+    std::vector<SaveJob> jobs;
+    collectSaveJobs(files, outDir, inPlace, jobs);
+
+    // Every job only reads its own subtree and writes its own output, so they never share anything.
+    for (auto& job : jobs)
+        m_loadPool.start([this, &job]() { prepareSave(job); });
+    m_loadPool.waitForDone();
+
+    // If anything couldn't be prepared, nothing is replaced. The temporary files of the other
+    // jobs are discarded along with them.
+    QStringList failedFiles;
+    for (const auto& job : jobs)
+        if (!job.prepared) failedFiles.push_back(job.outPath);
+    if (!failedFiles.isEmpty())
+    {
+        KFMTError::error(QStringLiteral("Couldn't save these files, so nothing was saved:\n%1")
+                             .arg(failedFiles.join(QLatin1Char('\n'))));
+        return;
+    }
+
+    static const QString kindNames[] = {QStringLiteral("copied"),
+                                        QStringLiteral("patched"),
+                                        QStringLiteral("copied and patched"),
+                                        QStringLiteral("rebuilt")};
+    size_t savedFiles = 0;
+    for (auto& job : jobs)
+    {
+        bool saved = false;
+        if (job.kind == SaveJob::Kind::Patch)
+        {
+            QFile output(job.outPath);
+            saved = output.open(QIODevice::ReadWrite)
+                    && KFMTFile::applyPatches(output, job.patches);
+        }
+        else
+        {
+            // A source being replaced may still be mapped, and the tree may still point into it.
+            if (inPlace) releaseSource(*job.file, job.srcPath);
+            saved = job.output->commit();
+        }
+
+        if (!saved)
+        {
+            KFMTError::error(QStringLiteral("Couldn't write %1.").arg(job.outPath));
+            continue;
+        }
+
+        KFMTError::log(QStringLiteral("KFMTCore::saveTo: %1 %2 in %3 ms.")
+                           .arg(job.file->path(), kindNames[static_cast<int>(job.kind)])
+                           .arg(job.elapsedMs));
+        if (job.kind == SaveJob::Kind::Copy) continue;
+
+        savedFiles++;
+        // Dirty means "different from the source directory", so that only changes when saving
+        // over it.
+        if (!inPlace) continue;
+        if (job.kind == SaveJob::Kind::Rebuild)
+        {
+            // The tree still has the layout the file was loaded with, which the new source may
+            // not. Its subfiles keep the copies releaseSource gave them.
+            auto& source = m_mappedSources.emplace_back(job.srcPath);
+            auto data = readSourceFile(source, job.srcPath);
+            if (!source.isOpen()) m_mappedSources.pop_back();
+            job.file->m_data = data.isEmpty() ? job.file->contents() : data;
+        }
+        job.file->clearDirty();
+    }
+
+    KFMTError::log(QStringLiteral("KFMTCore::saveTo: Wrote %1 changed files in %2 ms using %3 "
+                                  "threads.")
+                       .arg(savedFiles)
+                       .arg(saveTimer.elapsed())
+                       .arg(m_loadPool.maxThreadCount()));
+}
+
+void KFMTCore::releaseSource(KFMTFile& file, const QString& path)
+{
+    // The file's data is replaced with the new source once it's written, and its subfiles can't
+    // be left looking into the old one.
+    file.ownData();
+
+    // Windows can't replace a file while it's mapped. Everywhere else the old mapping would just
+    // live on until the next load.
+    const auto source = std::find_if(m_mappedSources.begin(), m_mappedSources.end(),
+                                     [&path](const QFile& handle) {
+                                         return handle.fileName() == path;
+                                     });
+    if (source != m_mappedSources.end()) m_mappedSources.erase(source);
+}
+
+void KFMTCore::saveToImage()
+{
+    if (m_curGame == VersionedGame::None || !m_discImage) return;
+
+    QElapsedTimer saveTimer;
+    saveTimer.start();
+
+    files.clearUnchanged();
+    std::vector<SaveJob> jobs;
+    collectSaveJobs(files, m_curSourceDirectory, true, jobs);
+
+    // Writes go to a single file, so there's nothing to gain from the pool here. T files are
+    // rebuilt in memory, but only the sectors that differ get written.
+    size_t savedFiles = 0;
+    for (const auto& job : jobs)
+    {
+        QElapsedTimer fileTimer;
+        fileTimer.start();
+        const auto contents = job.file->contents();
+        // The file and everything split out of it may be views of the sectors about to be
+        // overwritten. Files that aren't being written are left alone, since their sectors are.
+        job.file->ownData();
+        if (!m_discImage->writeFile(job.srcPath, contents)) continue;
+        job.file->m_data = contents;
+
+        KFMTError::log(QStringLiteral("KFMTCore::saveToImage: wrote %1 in %2 ms.")
+                           .arg(job.srcPath)
+                           .arg(fileTimer.elapsed()));
+        savedFiles++;
+        job.file->clearDirty();
+    }
+
+    KFMTError::log(QStringLiteral("KFMTCore::saveToImage: Wrote %1 of %2 changed files into %3 in "
+                                  "%4 ms.")
+                       .arg(savedFiles)
+                       .arg(jobs.size())
+                       .arg(m_discImage->imagePath())
+                       .arg(saveTimer.elapsed()));
 }
 
-void KFMTCore::detectGame(const QDir& srcDir)
+std::vector<std::vector<KFMTFile*>> KFMTCore::duplicateGroups()
 {
-    if (srcDir.exists("SCUS_941.82") || srcDir.exists("SLUS_013.23"))
+    std::unordered_map<uint64_t, std::vector<KFMTFile*>> filesByHash;
+    indexContents(files, filesByHash);
+
+    std::vector<std::vector<KFMTFile*>> groups;
+    for (auto& [hash, sameHash] : filesByHash)
+    {
+        // Hashes can collide, so files are only grouped with files that are really the same.
+        while (sameHash.size() > 1)
+        {
+            const auto& data = sameHash.front()->m_data;
+            const auto different = std::stable_partition(sameHash.begin(), sameHash.end(),
+                                                         [&data](const KFMTFile* file) {
+                                                             return file->m_data == data;
+                                                         });
+            if (different - sameHash.begin() > 1) groups.emplace_back(sameHash.begin(), different);
+            sameHash.erase(sameHash.begin(), different);
+        }
+    }
+
+    // Most wasted memory first, then in tree order.
+    const auto wasted = [](const std::vector<KFMTFile*>& group) {
+        return static_cast<qint64>(group.front()->m_data.size())
+               * static_cast<qint64>(group.size() - 1);
+    };
+    std::sort(groups.begin(), groups.end(), [&wasted](const auto& lhs, const auto& rhs) {
+        return wasted(lhs) > wasted(rhs);
+    });
+    return groups;
+}
+
+void KFMTCore::indexContents(KFMTFile& folder,
+                             std::unordered_map<uint64_t, std::vector<KFMTFile*>>& filesByHash)
+{
+    for (auto& file : folder.m_subFiles)
+    {
+        if (!file->m_subFiles.empty())
+        {
+            indexContents(*file, filesByHash);
+            continue;
+        }
+
+        file->loadData();
+        if (!file->m_data.isEmpty())
+            filesByHash[file->contentHash()].push_back(file.get());
+    }
+}
+
+void KFMTCore::collectSaveJobs(KFMTFile& folder, const QDir& outDir, const bool inPlace,
+                               std::vector<SaveJob>& jobs)
+{
+    for (auto& file : folder.m_subFiles)
+    {
+        if (file->format() == KFMTFile::FileFormat::Folder)
+        {
+            collectSaveJobs(*file, outDir, inPlace, jobs);
+            continue;
+        }
+
+        // Saving over the source directory leaves unchanged files alone.
+        if (inPlace && !file->isDirty()) continue;
+
+        const auto path = file->path();
+        if (!file->isDirty() && !sourceExists(path))
+        {
+            KFMTError::log(QStringLiteral("KFMTCore::collectSaveJobs: %1 doesn't exist, not "
+                                          "copying it.").arg(path));
+            continue;
+        }
+
+        if (!inPlace) outDir.mkpath(QFileInfo(path).path());
+
+        auto& job = jobs.emplace_back();
+        job.file = file.get();
+        job.srcPath = m_discImage ? path : m_curSourceDirectory.filePath(path);
+        job.outPath = outDir.filePath(path);
+        // Created here so it belongs to this thread, it's only opened and written on the pool.
+        job.output = std::make_unique<QSaveFile>(job.outPath);
+    }
+}
+
+void KFMTCore::prepareSave(SaveJob& job) const
+{
+    QElapsedTimer jobTimer;
+    jobTimer.start();
+
+    auto& file = *job.file;
+    auto& output = *job.output;
+    QFile sourceFile(job.srcPath);
+    QBuffer imageSource;
+    if (m_discImage) imageSource.setData(m_discImage->read(job.srcPath));
+    QIODevice& source = m_discImage ? static_cast<QIODevice&>(imageSource) : sourceFile;
+
+    const auto copySource = [&source, &output]() {
+        static constexpr qint64 chunkSize = 1 << 20;
+        if (!source.seek(0)) return false;
+        while (!source.atEnd())
+        {
+            const auto chunk = source.read(chunkSize);
+            if (chunk.isEmpty() || output.write(chunk) != chunk.size()) return false;
+        }
+        return true;
+    };
+
+    if (!file.isDirty())
+    {
+        job.kind = SaveJob::Kind::Copy;
+        job.prepared = source.open(QIODevice::ReadOnly) && output.open(QIODevice::WriteOnly)
+                       && copySource();
+    }
+    // Dirty T files are patched whenever their source still has the layout they were split from.
+    else if (file.format() == KFMTFile::FileFormat::T && file.isExpanded()
+             && source.open(QIODevice::ReadOnly) && file.tPatches(source, job.patches))
+    {
+        if (job.srcPath == job.outPath)
+        {
+            job.kind = SaveJob::Kind::Patch;
+            job.prepared = true;
+        }
+        else
+        {
+            job.kind = SaveJob::Kind::PatchCopy;
+            job.prepared = output.open(QIODevice::WriteOnly) && copySource()
+                           && KFMTFile::applyPatches(output, job.patches);
+        }
+    }
+    else
+    {
+        job.kind = SaveJob::Kind::Rebuild;
+        if (output.open(QIODevice::WriteOnly))
+        {
+            file.writeContents(output);
+            job.prepared = output.error() == QFileDevice::NoError;
+        }
+    }
+
+    if (!job.prepared)
+        KFMTError::log(QStringLiteral("KFMTCore::prepareSave: Couldn't prepare %1: %2")
+                           .arg(job.outPath, output.errorString()));
+
+    job.elapsedMs = jobTimer.elapsed();
+}
+
+void KFMTCore::detectGame()
+{
+    m_curGame = VersionedGame::None;
+    // Disc images are mapped, so identifying them never reads much in the first place.
+    if (m_discImage)
+    {
+        identifyGame();
+        return;
+    }
+
+    // Results are cached per directory along with its fingerprint, so reopening a game only stats
+    // and samples a few files instead of reading and hashing them.
+    const auto& srcDir = m_curSourceDirectory;
+    QSettings settings(QStringLiteral("FSMC"), QStringLiteral("FSModTool"));
+    const auto dirPath = srcDir.canonicalPath().toUtf8();
+    settings.beginGroup(QStringLiteral("detectedGames/%1")
+                            .arg(Utilities::contentHash(dirPath), 16, 16, QLatin1Char('0')));
+
+    const auto dirFingerprint = fingerprint(srcDir);
+    if (settings.value(QStringLiteral("path")).toByteArray() == dirPath
+        && settings.value(QStringLiteral("fingerprint")).toULongLong() == dirFingerprint)
+    {
+        m_curGame = static_cast<VersionedGame>(settings.value(QStringLiteral("game")).toInt());
+        return;
+    }
+
+    identifyGame();
+
+    settings.setValue(QStringLiteral("path"), dirPath);
+    settings.setValue(QStringLiteral("fingerprint"), static_cast<qulonglong>(dirFingerprint));
+    settings.setValue(QStringLiteral("game"), static_cast<int>(m_curGame));
+}
+
+uint64_t KFMTCore::fingerprint(const QDir& srcDir)
+{
+    // Everything identifyGame looks at.
+    static constexpr const char* probes[] = {
+        "AC.EXE",      "COM/DEMO00.XA", "COM/DEMO01.XA", "COPY.TXT",    "DEMO1",
+        "E0",          "E1",            "E2",            "E3",          "END.EXE",
+        "GAME.EXE",    "KFIELD.EXE",    "LICENSEE.DAT",  "MAP.001",     "OPEN.EXE",
+        "PSX.EXE",     "SCES_005.10",   "SCUS_941.82",   "SLPM_800.29", "SLPS_003.77",
+        "SLPS_009.00", "SLPS_014.20",   "SLPS_910.03",   "SLUS_001.58", "SLUS_002.55",
+        "SLUS_008.63", "SLUS_013.23",   "ST.EXE",        "STR",         "TITLE.XA",
+        "USA10.EXE"};
+
+    // The size of every probe and evenly spaced samples of its contents, hashed together.
+    QByteArray record;
+    for (const auto& probe : probes)
+    {
+        const QFileInfo info(srcDir.filePath(QLatin1String(probe)));
+        const qint64 size = info.exists() ? info.size() : -1;
+        record += probe;
+        record.append(reinterpret_cast<const char*>(&size), sizeof(size));
+        if (!info.isFile()) continue;
+
+        QFile file(info.filePath());
+        if (file.open(QIODevice::ReadOnly)) appendSamples(file, size, record);
+    }
+
+    return Utilities::contentHash(record);
+}
+
+void KFMTCore::appendSamples(QIODevice& file, const qint64 size, QByteArray& record)
+{
+    static constexpr qint64 sampleCount = 16;
+    static constexpr qint64 sampleSize = 256;
+
+    if (size <= sampleCount * sampleSize)
+    {
+        record += file.readAll();
+        return;
+    }
+    for (qint64 sample = 0; sample < sampleCount; sample++)
+    {
+        file.seek((size - sampleSize) * sample / (sampleCount - 1));
+        record += file.read(sampleSize);
+    }
+}
+
+std::optional<uint64_t> KFMTCore::sourceFingerprint(const QString& path) const
+{
+    QFile sourceFile(m_curSourceDirectory.filePath(path));
+    QBuffer imageSource;
+    if (m_discImage) imageSource.setData(m_discImage->read(path));
+    QIODevice& source = m_discImage ? static_cast<QIODevice&>(imageSource) : sourceFile;
+    if (!source.open(QIODevice::ReadOnly)) return std::nullopt;
+
+    const auto size = source.size();
+    QByteArray record(reinterpret_cast<const char*>(&size), sizeof(size));
+    appendSamples(source, size, record);
+    return Utilities::contentHash(record);
+}
+
+void KFMTCore::identifyGame()
+{
+    if (sourceExists("SCUS_941.82") || sourceExists("SLUS_013.23"))
         m_curGame = VersionedGame::ACU;
-    else if (srcDir.exists("STR") && srcDir.exists("AC.EXE")) m_curGame = VersionedGame::ACJDemoD2;
-    else if (srcDir.exists("STR") && srcDir.exists("DEMO1")) m_curGame = VersionedGame::ACJDemoHR7;
-    else if (srcDir.exists("USA10.EXE"))
+    else if (sourceExists("STR") && sourceExists("AC.EXE")) m_curGame = VersionedGame::ACJDemoD2;
+    else if (sourceExists("STR") && sourceExists("DEMO1")) m_curGame = VersionedGame::ACJDemoHR7;
+    else if (sourceExists("USA10.EXE"))
     {
-        if (srcDir.exists(QStringLiteral("COM%1DEMO00.XA").arg(QDir::separator())))
+        if (sourceExists(QStringLiteral("COM/DEMO00.XA")))
             m_curGame = VersionedGame::ACUDemoISV4;
-        else if (srcDir.exists(QStringLiteral("COM%1DEMO01.XA").arg(QDir::separator())))
+        else if (sourceExists(QStringLiteral("COM/DEMO01.XA")))
             m_curGame = VersionedGame::ACUDemoPUG3;
     }
-    else if (!srcDir.exists("STR") && srcDir.exists("AC.EXE"))
+    else if (!sourceExists("STR") && sourceExists("AC.EXE"))
         m_curGame = VersionedGame::ACJDemoT977;
-    else if (srcDir.exists("SLPS_009.00")) m_curGame = VersionedGame::ACUProto;
-    else if (srcDir.exists("PSX.EXE") && srcDir.exists("E0") && srcDir.exists("E1")
-             && srcDir.exists("E2") && srcDir.exists("E3"))
+    else if (sourceExists("SLPS_009.00")) m_curGame = VersionedGame::ACUProto;
+    else if (sourceExists("PSX.EXE") && sourceExists("E0") && sourceExists("E1")
+             && sourceExists("E2") && sourceExists("E3"))
         m_curGame = VersionedGame::KF;
-    else if (srcDir.exists("KFIELD.EXE") && srcDir.exists("MAP.001"))
+    else if (sourceExists("KFIELD.EXE") && sourceExists("MAP.001"))
         m_curGame = VersionedGame::KFJDemo;
-    else if (srcDir.exists("SCES_005.10") && srcDir.exists("END.EXE")
-             && srcDir.exists("LICENSEE.DAT"))
+    else if (sourceExists("SCES_005.10") && sourceExists("END.EXE")
+             && sourceExists("LICENSEE.DAT"))
         m_curGame = VersionedGame::KF2E;
-    else if (srcDir.exists("END.EXE") && srcDir.exists("GAME.EXE") && srcDir.exists("OPEN.EXE")
-             && srcDir.exists("PSX.EXE"))
+    else if (sourceExists("END.EXE") && sourceExists("GAME.EXE") && sourceExists("OPEN.EXE")
+             && sourceExists("PSX.EXE"))
     {
-        auto gameExeHandle = QFile(srcDir.absoluteFilePath("GAME.EXE"));
-        if (!gameExeHandle.open(QIODevice::ReadOnly)) return;
+        // Releases are told apart by the same samples fingerprint() takes. GAME.EXE is only hashed
+        // in full the first time a release is seen anywhere, after that its samples are enough.
+        const auto exeFingerprint = sourceFingerprint(QStringLiteral("GAME.EXE"));
+        if (!exeFingerprint) return;
+
+        QSettings settings(QStringLiteral("FSMC"), QStringLiteral("FSModTool"));
+        const auto knownKey = QStringLiteral("knownGameExes/%1")
+                                  .arg(*exeFingerprint, 16, 16, QLatin1Char('0'));
+        const auto known = settings.value(knownKey);
+        if (known.isValid())
+        {
+            m_curGame = static_cast<VersionedGame>(known.toInt());
+            return;
+        }
 
-        auto gameExeHash = QCryptographicHash::hash(gameExeHandle.readAll(),
+        const auto gameExe = readWholeSource("GAME.EXE");
+        if (gameExe.isEmpty()) return;
+
+        auto gameExeHash = QCryptographicHash::hash(gameExe,
                                                     QCryptographicHash::Algorithm::Md5);
         if (gameExeHash == QByteArray::fromHex("20e673906133201fded29b3af6d7b6cd"))
             m_curGame = VersionedGame::KF2Jv1_0;
         else if (gameExeHash == QByteArray::fromHex("5522e7cdeb6c0261befd6eedf95065a3"))
             m_curGame = VersionedGame::KF2Jv1_7;
+
+        if (m_curGame != VersionedGame::None)
+            settings.setValue(knownKey, static_cast<int>(m_curGame));
     }
-    else if (srcDir.exists("SLPS_910.03"))
+    else if (sourceExists("SLPS_910.03"))
     {
-        auto copyTxtHandle = QFile(srcDir.absoluteFilePath("COPY.TXT"));
-        if (!copyTxtHandle.open(QIODevice::ReadOnly)) return;
-
-        const auto copyTxt = copyTxtHandle.readAll();
+        const auto copyTxt = readWholeSource("COPY.TXT");
+        if (copyTxt.isEmpty()) return;
 
         if (copyTxt.contains(QByteArrayLiteral("1.8A"))) m_curGame = VersionedGame::KF2Jv1_8A;
         else if (copyTxt.contains(QByteArrayLiteral("1.8B"))) m_curGame = VersionedGame::KF2Jv1_8B;
@@ -272,13 +882,11 @@ void KFMTCore::detectGame(const QDir& srcDir)
                 QStringLiteral("Your copy of KF2 could not be identified. Please open an issue on "
                                "our GitHub repo or contact us on Discord!"));
     }
-    else if (srcDir.exists("SLUS_001.58")) m_curGame = VersionedGame::KF2U;
-    else if (srcDir.exists("SLPS_003.77"))
+    else if (sourceExists("SLUS_001.58")) m_curGame = VersionedGame::KF2U;
+    else if (sourceExists("SLPS_003.77"))
     {
-        auto copyTxtHandle = QFile(srcDir.absoluteFilePath("COPY.TXT"));
-        if (!copyTxtHandle.open(QIODevice::ReadOnly)) return;
-
-        const auto copyTxt = copyTxtHandle.readAll();
+        const auto copyTxt = readWholeSource("COPY.TXT");
+        if (copyTxt.isEmpty()) return;
 
         if (copyTxt.contains(QByteArrayLiteral("1.3"))) m_curGame = VersionedGame::KF3Jv1_3;
         else if (copyTxt.contains(QByteArrayLiteral("1.4"))) m_curGame = VersionedGame::KF3Jv1_4;
@@ -287,14 +895,12 @@ void KFMTCore::detectGame(const QDir& srcDir)
                 QStringLiteral("Your copy of KF3 could not be identified. Please open an issue on "
                                "our GitHub repo or contact us on Discord!"));
     }
-    else if (srcDir.exists("SLUS_002.55")) m_curGame = VersionedGame::KF3U;
-    else if (srcDir.exists("SLPM_800.29")) m_curGame = VersionedGame::KFPS;
-    else if (srcDir.exists("SLPS_014.20"))
+    else if (sourceExists("SLUS_002.55")) m_curGame = VersionedGame::KF3U;
+    else if (sourceExists("SLPM_800.29")) m_curGame = VersionedGame::KFPS;
+    else if (sourceExists("SLPS_014.20"))
     {
-        auto copyTxtHandle = QFile(srcDir.absoluteFilePath("COPY.TXT"));
-        if (!copyTxtHandle.open(QIODevice::ReadOnly)) return;
-
-        const auto copyTxt = copyTxtHandle.readAll();
+        const auto copyTxt = readWholeSource("COPY.TXT");
+        if (copyTxt.isEmpty()) return;
 
         if (copyTxt.contains(QByteArrayLiteral("1.4"))) m_curGame = VersionedGame::STJv1_4;
         else if (copyTxt.contains(QByteArrayLiteral("2.2"))) m_curGame = VersionedGame::STJv2_2;
@@ -303,10 +909,10 @@ void KFMTCore::detectGame(const QDir& srcDir)
                 QStringLiteral("Your copy of Shadow Tower could not be identified. Please open an "
                                "issue on our GitHub repo or contact us on Discord!"));
     }
-    else if (srcDir.exists("SLUS_008.63")) m_curGame = VersionedGame::STU;
-    else if (srcDir.exists("ST.EXE") && srcDir.exists("TITLE.XA"))
+    else if (sourceExists("SLUS_008.63")) m_curGame = VersionedGame::STU;
+    else if (sourceExists("ST.EXE") && sourceExists("TITLE.XA"))
     {
-        if (srcDir.exists("PSX.EXE")) m_curGame = VersionedGame::STUDemo;
+        if (sourceExists("PSX.EXE")) m_curGame = VersionedGame::STUDemo;
         else m_curGame = VersionedGame::STJDemo;
     }
     else m_curGame = VersionedGame::None;
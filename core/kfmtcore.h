@@ -1,7 +1,15 @@
 #ifndef KFMTCORE_H
 #define KFMTCORE_H
 
+#include "discimage.h"
 #include "kfmtfile.h"
+#include "filelists.h"
+#include "projectindex.h"
+#include <QFile>
+#include <QSaveFile>
+#include <QThreadPool>
+#include <list>
+#include <unordered_map>
 #include <optional>
 
 class KFMTCore
@@ -65,11 +73,78 @@ public:
         STUDemo    ///< Shadow Tower (USA) Demo from PlayStation Underground v2.4 [SCUS-94298]
     };
 
+    /*!
+     * \brief Enum that defines how source files are brought into memory when loading a game.
+     */
+    enum class LoadMode
+    {
+        Copy,        ///< Every source file is read into its own heap buffer.
+        MemoryMapped ///< Every source file is mapped once and KFMTFiles get views into the mapping.
+    };
+
     inline VersionedGame currentVersionedGame() const { return m_curGame; }
     QDir getSrcDir() const { return m_curSourceDirectory; }
 
+    inline LoadMode loadMode() const { return m_loadMode; }
+    /*!
+     * \brief Setter for the load mode. Only takes effect on the next call to loadFrom.
+     * \param loadMode New load mode.
+     */
+    inline void setLoadMode(const LoadMode loadMode) { m_loadMode = loadMode; }
+
+    inline int loadThreadCount() const { return m_loadPool.maxThreadCount(); }
+    /*!
+     * \brief Setter for the amount of threads used to read and split source files when loading.
+     * \param threadCount New thread count. 0 or less means QThread::idealThreadCount().
+     */
+    void setLoadThreadCount(int threadCount);
+
+    inline const QString& customFileList() const { return m_customFileListPath; }
+    /*!
+     * \brief Sets a file list to load games with instead of the built-in ones.
+     * Only takes effect on the next call to loadFrom.
+     * \param path Path to the CSV file list, or an empty string to use the built-in file lists.
+     */
+    inline void setCustomFileList(const QString& path) { m_customFileListPath = path; }
+
+    /*!
+     * \brief Loads a game from a directory.
+     * An index of the loaded files is kept next to the game, see ProjectIndex. Source files that
+     * didn't change since it was written are rebuilt from it instead of being split again.
+     */
     void loadFrom(const QDir& srcDir);
+    /*!
+     * \brief Loads a game straight from a disc image, see DiscImage for the supported formats.
+     * Saving writes to a directory, like when loading from one, unless saveToImage is used.
+     * \param imagePath Path to a .cue, .bin or .iso file.
+     */
+    void loadFromImage(const QString& imagePath);
+    /*!
+     * \brief Saves the game to a directory.
+     * Only files that changed are written. Saving over the source directory leaves every other
+     * file alone, while saving anywhere else copies them over from the source directory.
+     * Every source file is prepared on the thread pool first, into temporary files or patches.
+     * They only replace their output once all of them were prepared successfully.
+     */
     void saveTo(const QDir& outDir);
+    /*!
+     * \brief Writes the changed files straight into the disc image they were loaded from.
+     * See DiscImage::writeFile. Files that couldn't be written stay changed, so they can still be
+     * saved to a directory.
+     */
+    void saveToImage();
+    /*!
+     * \brief Whether the current game was loaded from a disc image.
+     */
+    [[nodiscard]] inline bool loadedFromImage() const { return m_discImage != nullptr; }
+
+    /*!
+     * \brief Finds files with the same contents, anywhere in the tree.
+     * Only files that aren't split into subfiles are compared, and containers that haven't been
+     * split aren't looked into. Files are matched by the hash they were loaded with.
+     * \return Groups of identical files, the ones wasting the most space first.
+     */
+    std::vector<std::vector<KFMTFile*>> duplicateGroups();
 
     // This member breaks the naming standard on purpose.
     // The idea is that with this we can just use core.files["PATH/TO/FILE"].
@@ -84,13 +159,105 @@ public:
                     QStringLiteral(u"Root")};
 
 private:
-    void detectGame(const QDir& srcDir);
-    KFMTFile::DataType parseDataType(const QString& dataTypeStr);
-    KFMTFile::FileFormat parseFileFormat(const QString& fileTypeStr);
-    void loadFileList(const QString& fileList);
+    /*!
+     * \brief Source file that a file list line created, waiting to be read.
+     */
+    struct SourceRead
+    {
+        KFMTFile* file; ///< File the data goes into.
+        QString path;   ///< Path relative to the source directory.
+        QFile* source;  ///< Handle for the file, owned by m_mappedSources.
+        qint64 size = -1;     ///< Size of the source file, or of the disc image.
+        qint64 modified = 0;  ///< Modification time of the same, in ms since the epoch.
+        qint64 indexNode = -1; ///< Node of the file in the project index, if it's still valid.
+    };
+
+    /*!
+     * \brief Source file being saved by saveTo.
+     */
+    struct SaveJob
+    {
+        /*!
+         * \brief How the file gets to its output path.
+         */
+        enum class Kind
+        {
+            Copy,      ///< Unchanged file, copied from the source directory.
+            Patch,     ///< T file saved over its source, only the dirty subfiles are written.
+            PatchCopy, ///< Copy of a T file, with its dirty subfiles written over the copy.
+            Rebuild    ///< File rebuilt from the tree.
+        };
+
+        KFMTFile* file = nullptr;
+        QString srcPath; ///< Path of the source file, or its path in the disc image.
+        QString outPath;
+        std::unique_ptr<QSaveFile> output; ///< Committed once every job was prepared.
+        KFMTFile::Patches patches;         ///< Written once every job was prepared (Kind::Patch).
+        Kind kind = Kind::Copy;
+        bool prepared = false;
+        qint64 elapsedMs = 0;
+    };
+
+    void load();
+    void resetSources();
+    bool sourceExists(const QString& path) const;
+    QByteArray readWholeSource(const QString& path) const;
+    void detectGame();
+    void identifyGame();
+    static uint64_t fingerprint(const QDir& srcDir);
+    /*!
+     * \brief Appends the samples fingerprint() takes of a file's contents to a record.
+     */
+    static void appendSamples(QIODevice& file, qint64 size, QByteArray& record);
+    /*!
+     * \brief Hashes the size and samples of a single source file, the same way fingerprint() does.
+     * \return The hash, or nothing if the file couldn't be opened.
+     */
+    std::optional<uint64_t> sourceFingerprint(const QString& path) const;
+    void loadFileList(const FileLists::Table& fileList, std::vector<SourceRead>& reads);
+    QString indexPath() const;
+    void loadSources(std::vector<SourceRead>& reads, const ProjectIndex& index);
+    void verifyChecksums(const std::vector<SourceRead>& reads);
+    void writeIndex(const std::vector<SourceRead>& reads);
+    QByteArray readSourceFile(QFile& file, const QString& path);
+    void indexContents(KFMTFile& folder,
+                       std::unordered_map<uint64_t, std::vector<KFMTFile*>>& filesByHash);
+    void collectSaveJobs(KFMTFile& folder, const QDir& outDir, bool inPlace,
+                         std::vector<SaveJob>& jobs);
+    void prepareSave(SaveJob& job) const;
+    /*!
+     * \brief Lets go of a source file that's about to be replaced by saveTo.
+     * The file and everything inside it get copies of their data, and the source is unmapped.
+     * Once the new source is in place, the file is read from it again.
+     */
+    void releaseSource(KFMTFile& file, const QString& path);
 
     VersionedGame m_curGame = VersionedGame::None;
     QDir m_curSourceDirectory;
+    LoadMode m_loadMode = LoadMode::MemoryMapped;
+    QString m_customFileListPath;
+    /*!
+     * \brief Contents of the custom file list the tree was loaded with, if any.
+     * File names in the tree point into this, so it must only be replaced after resetting the tree.
+     */
+    QString m_customFileListData;
+    std::vector<FileLists::Entry> m_customFileListEntries;
+    /*!
+     * \brief Source files kept open for LoadMode::MemoryMapped.
+     * The data of every KFMTFile loaded from these points straight into their mappings, so they
+     * must only be closed after the file tree has been reset, or after the files loaded from them
+     * got copies of their data (see releaseSource).
+     */
+    std::list<QFile> m_mappedSources;
+    /*!
+     * \brief Disc image the game was loaded from, if any. Same lifetime rules as m_mappedSources.
+     */
+    std::unique_ptr<DiscImage> m_discImage;
+    /*!
+     * \brief Pool that reads source files and splits the containers the file lists look into.
+     * Saving prepares the source files on it too.
+     */
+    QThreadPool m_loadPool;
 
     // FileListModel needs access to the files member.
     friend class FileListModel;
@@ -1,5 +1,7 @@
 #include "core/kfmterror.h"
+#include <QApplication>
 #include <QMessageBox>
+#include <QThread>
 #include <iostream>
 
 static QWidget* KFMTErrorParent;
@@ -13,10 +15,26 @@ static const auto failAssertStr = QStringLiteral(
 static const auto fatalErrorStr = QStringLiteral("Fatal Error: ");
 static const auto warningStr = QStringLiteral("Warning: ");
 
-void KFMTError::error(const QString & errorMessage)
+/*!
+ * \brief Whether message boxes can be shown from the calling thread.
+ * Files are loaded on a thread pool, but widgets only work on the GUI thread.
+ */
+static bool onGuiThread()
 {
-    log(errorStr + errorMessage);
+    return qApp == nullptr || QThread::currentThread() == qApp->thread();
+}
 
+/*!
+ * \brief Whether there's a GUI to show message boxes in. Batch mode runs without one, so errors
+ * only go to the log there.
+ */
+static bool hasGui()
+{
+    return qobject_cast<QApplication*>(QCoreApplication::instance()) != nullptr;
+}
+
+static void showError(const QString& errorMessage)
+{
     if (!lastErrors.empty()
         && (errorMessage == lastErrors.front() || errorMessage == lastErrors.back()))
         return;
@@ -27,6 +45,21 @@ void KFMTError::error(const QString & errorMessage)
     QMessageBox::critical(KFMTErrorParent, QStringLiteral("Error"), errorMessage);
 }
 
+void KFMTError::error(const QString & errorMessage)
+{
+    log(errorStr + errorMessage);
+    if (!hasGui()) return;
+
+    if (!onGuiThread())
+    {
+        QMetaObject::invokeMethod(
+            qApp, [errorMessage]() { showError(errorMessage); }, Qt::QueuedConnection);
+        return;
+    }
+
+    showError(errorMessage);
+}
+
 void KFMTError::failAssert(const QString& assertExpr, const QString& fileName, uint16_t line, const QString& reason)
 {
     KFMTError::fatalError(failAssertStr.arg(assertExpr).arg(fileName).arg(line).arg(reason));
@@ -35,7 +68,9 @@ void KFMTError::failAssert(const QString& assertExpr, const QString& fileName, u
 void KFMTError::fatalError(const QString & fatalErrorMessage)
 {
     log(fatalErrorStr + fatalErrorMessage);
-    QMessageBox::critical(KFMTErrorParent, QStringLiteral("Fatal Error"), fatalErrorMessage);
+    // Off the GUI thread there's no way to show this before going down, so the log has to do.
+    if (hasGui() && onGuiThread())
+        QMessageBox::critical(KFMTErrorParent, QStringLiteral("Fatal Error"), fatalErrorMessage);
     throw;
 }
 
@@ -52,5 +87,18 @@ void KFMTError::setParent(QWidget* parentPtr)
 void KFMTError::warning(const QString & warningMessage)
 {
     log(warningStr + warningMessage);
+    if (!hasGui()) return;
+
+    if (!onGuiThread())
+    {
+        QMetaObject::invokeMethod(
+            qApp,
+            [warningMessage]() {
+                QMessageBox::warning(KFMTErrorParent, QStringLiteral("Warning"), warningMessage);
+            },
+            Qt::QueuedConnection);
+        return;
+    }
+
     QMessageBox::warning(KFMTErrorParent, QStringLiteral("Warning"), warningMessage);
 }
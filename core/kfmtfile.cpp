@@ -1,44 +1,92 @@
 #include "kfmtfile.h"
+#include "binaryreader.h"
 #include "kfmterror.h"
 #include "formats/ps1/seq.h"
 #include "formats/ps1/tim.h"
 #include "formats/ps1/tmd.h"
 #include "formats/ps1/vab.h"
 #include "utilities.h"
+#include <QBuffer>
+#include <utility>
 
 KFMTFile::KFMTFile(const QString& name, const QByteArray& data, KFMTFile* const parent,
                    const FileFormat fileType, const DataType dataType, const QString& prettyName)
     : m_name(name), m_data(data), m_parent(parent), m_prettyName(prettyName), m_fileType(fileType),
-      m_dataType(dataType)
+      m_dataType(dataType), m_sourceData(data), m_expanded(!isSplitFormat(fileType))
+{}
+
+KFMTFile::KFMTFile(const QString& name, const QByteArray& data, KFMTFile* const parent,
+                   const DataType dataType)
+    : m_name(name), m_data(data), m_parent(parent), m_fileType(FileFormat::Raw),
+      m_dataType(dataType), m_sourceData(data), m_expanded(true)
+{}
+
+void KFMTFile::expand()
 {
-    switch (fileType)
+    if (m_expanded.load(std::memory_order_acquire)) return;
+    loadData();
+
+    std::lock_guard lock(m_expandMutex);
+    // Someone else might have expanded this while we were waiting for the lock.
+    if (m_expanded.load(std::memory_order_relaxed)) return;
+
+    switch (m_fileType)
     {
         case FileFormat::MIMList: loadMIMList(); break;
         case FileFormat::MIX: loadMIX(); break;
         case FileFormat::T: loadT(); break;
         default: break;
     }
+
+    applyDeferredEntries();
+    m_expanded.store(true, std::memory_order_release);
 }
 
-void KFMTFile::extractTo(const QDir& outDir)
+bool KFMTFile::extractTo(const QDir& outDir)
 {
     if (m_dataType != DataType::Container)
     {
         KFMTError::error("KFMTFile::extractTo: Called on non-container file!");
-        return;
+        return false;
     }
 
+    expand();
+
+    bool extracted = true;
     size_t fileIndex = 0;
     for (const auto& subFile : m_subFiles) {
         auto fn = m_name.mid(m_name.lastIndexOf(QRegularExpression(QStringLiteral("[\\/]"))) + 1)
-                  + QString::number(fileIndex) + '.' + subFile.extension();
+                  + QString::number(fileIndex) + '.' + subFile->extension();
         QFile output(outDir.filePath(fn));
-        if (!output.open(QIODevice::WriteOnly))
-            KFMTError::fatalError("Unable to open output file for " + output.fileName());
-        output.write(subFile.m_data);
-        output.close();
         fileIndex++;
+        // This runs on batch mode's workers too, so failures are only reported, not fatal.
+        if (!output.open(QIODevice::WriteOnly)
+            || output.write(subFile->m_data) != subFile->m_data.size())
+        {
+            KFMTError::error(QStringLiteral("Unable to write %1: %2")
+                                 .arg(output.fileName(), output.errorString()));
+            extracted = false;
+        }
     }
+
+    return extracted;
+}
+
+Utilities::DetectedFormat KFMTFile::detectedFormat() const
+{
+    // Anything written to m_data detaches it from m_sourceData first, even if whoever wrote it
+    // never calls dataChanged(). Keying the cache on m_data's pointer instead would miss writes
+    // into a buffer it already owns, and buffers that were freed and reused.
+    const bool unwritten = m_data.constData() == m_sourceData.constData()
+                           && m_data.size() == m_sourceData.size();
+    if (!unwritten) return Utilities::detectFormat(m_data);
+
+    if (!m_detectedFormatValid)
+    {
+        m_detectedFormat = Utilities::detectFormat(m_data);
+        m_detectedFormatValid = true;
+    }
+    return m_detectedFormat;
 }
 
 const QString& KFMTFile::extension() const
@@ -56,61 +104,261 @@ const QString& KFMTFile::extension() const
     static const auto tim = QStringLiteral("tim");
     static const auto tmd = QStringLiteral("tmd");
 
-    if (Utilities::fileIsPSXEXE(m_data)) return exe;
-    if (Utilities::fileIsTMD(m_data)) return tmd;
-    if (Utilities::fileIsTIM(m_data)) return tim;
-    if (Utilities::fileIsRTIM(m_data)) return rtim;
-    if (Utilities::fileIsRTMD(m_data)) return rtmd;
-    if (Utilities::fileIsMIM(m_data)) return mim;
-    if (Utilities::fileIsMO(m_data)) return mo;
-    if (Utilities::fileIsMAP1(m_data)) return maptile;
-    if (Utilities::fileIsMAP2(m_data)) return mapdb;
-    if (Utilities::fileIsMAP3(m_data)) return mapscript;
-    if (Utilities::fileIsKF2GameDB(m_data)) return gamedb;
+    switch (detectedFormat())
+    {
+        case Utilities::DetectedFormat::PSXEXE: return exe;
+        case Utilities::DetectedFormat::TMD: return tmd;
+        case Utilities::DetectedFormat::TIM: return tim;
+        case Utilities::DetectedFormat::RTIM: return rtim;
+        case Utilities::DetectedFormat::RTMD: return rtmd;
+        case Utilities::DetectedFormat::MIM: return mim;
+        case Utilities::DetectedFormat::MO: return mo;
+        case Utilities::DetectedFormat::MAP1: return maptile;
+        case Utilities::DetectedFormat::MAP2: return mapdb;
+        case Utilities::DetectedFormat::MAP3: return mapscript;
+        case Utilities::DetectedFormat::KF2GameDB: return gamedb;
+        default: return data;
+    }
+}
+
+KFMTFile* KFMTFile::operator[](const QStringView& path)
+{
+    // Only lookups through the root are cached, since that's where editors look files up from.
+    const bool isRoot = m_parent == nullptr;
+    if (isRoot)
+    {
+        std::lock_guard lock(m_pathCacheMutex);
+        auto cached = m_pathCache.find(path);
+        if (cached != m_pathCache.end()) return cached->second;
+    }
+
+    KFMTFile* result = this;
+    for (qsizetype levelStart = 0; levelStart <= path.size();)
+    {
+        auto levelEnd = path.indexOf(QLatin1Char('/'), levelStart);
+        if (levelEnd == -1) levelEnd = path.size();
+
+        result->expand();
+        result = result->findChild(path.mid(levelStart, levelEnd - levelStart));
+        if (result == nullptr) // If we didn't find this level, we bail
+            return nullptr;
+
+        levelStart = levelEnd + 1;
+    }
+
+    if (isRoot)
+    {
+        std::lock_guard lock(m_pathCacheMutex);
+        m_pathCache.try_emplace(path.toString(), result);
+    }
+
+    return result;
+}
+
+void KFMTFile::recalculateChecksum(QByteArray& data)
+{
+    const auto ints = static_cast<uint32_t>(data.size() / 4);
+    if (ints == 0) return;
+
+    // Everything is read through const access so that data which already has the right checksum
+    // isn't detached from whatever it's a view into.
+    const auto& constData = data;
+    const auto checksum = Utilities::tChecksum(constData);
+    if (Utilities::as<quint32>(constData, (ints - 1) * 4) != checksum)
+        Utilities::as<quint32>(data, (ints - 1) * 4) = checksum;
+}
+
+void KFMTFile::verifyChecksum()
+{
+    m_badChecksum = !Utilities::hasValidTChecksum(m_data);
+}
 
+QByteArray KFMTFile::contents()
+{
+    loadData();
+    if (!m_dirty || !isExpanded() || !isSplitFormat(m_fileType)) return m_data;
+
+    QByteArray result;
+    QBuffer buffer(&result);
+    buffer.open(QIODevice::WriteOnly);
+    writeContents(buffer);
+    return result;
+}
+
+QByteArray KFMTFile::tSubFileContents()
+{
+    // Files that didn't change keep whatever they had in that word, checksum or not.
+    auto data = contents();
+    if (m_dirty)
+    {
+        recalculateChecksum(data);
+        m_badChecksum = false;
+    }
     return data;
 }
 
-void KFMTFile::recalculateChecksum()
+void KFMTFile::dataChanged()
 {
-    // FIXME: Use direct pointer stuff or std::accumulate to take advantage of vectorization.
-    // Should also help avoid QDataStream overhead.
-
-    auto ints = m_data.size() / 4 - 1;
-    QDataStream fileStream(&m_data, QIODevice::ReadWrite);
-    fileStream.setByteOrder(QDataStream::LittleEndian);
-    quint32 checksum = 0x12345678;
-    quint32 curInt = 0;
-    for (auto curIntIndex = 0; curIntIndex < ints; curIntIndex++) {
-        fileStream >> curInt;
-        checksum += curInt;
+    m_detectedFormatValid = false;
+    for (KFMTFile* file = this; file != nullptr; file = file->m_parent)
+        file->m_dirty = true;
+}
+
+bool KFMTFile::clearUnchanged()
+{
+    if (!m_dirty) return false;
+
+    // Files nobody wrote to still share their buffer with what they were loaded with.
+    if (m_subFiles.empty())
+        m_dirty = (m_data.constData() != m_sourceData.constData()
+                   || m_data.size() != m_sourceData.size())
+                  && m_data != m_sourceData;
+    else
+    {
+        bool anyDirty = false;
+        for (auto& subFile : m_subFiles)
+            anyDirty |= subFile->clearUnchanged();
+        m_dirty = anyDirty;
     }
-    fileStream << checksum;
+
+    return m_dirty;
+}
+
+void KFMTFile::clearDirty()
+{
+    // The source now has what this file has, so that's what clearUnchanged compares against. Keeping
+    // the data from loading would make reverting a saved change look like no change at all.
+    m_sourceData = m_data;
+    m_contentHash.reset();
+    m_detectedFormatValid = false;
+    m_dirty = false;
+    for (auto& subFile : m_subFiles)
+        subFile->clearDirty();
+}
+
+uint64_t KFMTFile::contentHash() const
+{
+    if (!m_contentHash) m_contentHash = Utilities::contentHash(m_sourceData);
+    return *m_contentHash;
+}
+
+void KFMTFile::loadData()
+{
+    std::call_once(m_loadOnce, [this]() {
+        if (!m_dataLoader) return;
+        // The project index may already know its hash.
+        setLoadedData(m_dataLoader(), m_contentHash);
+        m_dataLoader = nullptr;
+    });
+}
+
+void KFMTFile::setLoadedData(const QByteArray& data, const std::optional<uint64_t> contentHash)
+{
+    m_data = data;
+    m_sourceData = data;
+    m_contentHash = contentHash;
+    m_detectedFormatValid = false;
+}
+
+QString KFMTFile::path() const
+{
+    QStringList levels;
+    for (const KFMTFile* file = this; file->m_parent != nullptr; file = file->m_parent)
+        levels.prepend(file->m_name);
+    return levels.join(QLatin1Char('/'));
+}
+
+void KFMTFile::applyDeferredEntries()
+{
+    for (auto& entry : m_deferredEntries)
+    {
+        const auto separator = entry.path.indexOf('/');
+        const auto childName = entry.path.left(separator);
+
+        KFMTFile* child = findChild(childName);
+
+        if (child == nullptr)
+        {
+            KFMTError::log(QStringLiteral("KFMTFile::applyDeferredEntries: %1 has no file %2.")
+                               .arg(m_name, childName));
+            continue;
+        }
+
+        if (separator == -1)
+        {
+            child->setFileFormat(entry.format);
+            child->setDataType(entry.dataType);
+            child->setPrettyName(entry.prettyName);
+        }
+        else if (!child->isExpanded())
+        {
+            entry.path = entry.path.mid(separator + 1);
+            child->m_deferredEntries.push_back(std::move(entry));
+        }
+        else
+            KFMTError::log(QStringLiteral("KFMTFile::applyDeferredEntries: %1/%2 is not a "
+                                          "container.").arg(m_name, childName));
+    }
+
+    m_deferredEntries.clear();
+    m_deferredEntries.shrink_to_fit();
+}
+
+QByteArray KFMTFile::dataView(uint32_t offset, uint32_t size) const
+{
+    const auto dataSize = static_cast<uint32_t>(m_data.size());
+    if (offset >= dataSize) return {};
+
+    return QByteArray::fromRawData(m_data.constData() + offset,
+                                   static_cast<int>(std::min(size, dataSize - offset)));
+}
+
+void KFMTFile::ownData()
+{
+    // Children first, since they may be views into this file's data.
+    for (auto& subFile : m_subFiles)
+        subFile->ownData();
+
+    // Files that were written to got a copy of their own back then, which editors may be holding
+    // pointers into. What they were loaded with may still be a view, though.
+    if (m_data.constData() != m_sourceData.constData())
+        m_sourceData = QByteArray(m_sourceData.constData(), m_sourceData.size());
+    else
+    {
+        m_data = QByteArray(m_data.constData(), m_data.size());
+        m_sourceData = m_data;
+    }
+}
+
+KFMTFile* KFMTFile::findChild(QStringView name) const
+{
+    auto child = m_subFileIndex.find(name);
+    return child != m_subFileIndex.end() ? child->second : nullptr;
 }
 
 void KFMTFile::loadMIMList()
 {
     m_containerType = ContainerType::MIMList;
 
-    auto mimCount = Utilities::as<uint32_t>(m_data);
-    //m_subFiles.reserve(mimCount);
+    auto mimCount = Utilities::as<uint32_t>(std::as_const(m_data));
+    m_subFiles.reserve(mimCount);
 
     // We start at 4 to skip the MIM count
     uint32_t curOffset = 4;
 
     for (uint32_t i = 0; i < mimCount; i++)
     {
-        auto mimSize = Utilities::as<uint32_t>(m_data, curOffset);
+        auto mimSize = Utilities::as<uint32_t>(std::as_const(m_data), curOffset);
 
         createChild(QString::number(i),
-                    m_data.mid(curOffset, mimSize),
+                    dataView(curOffset, mimSize),
                     FileFormat::Raw,
                     DataType::Model);
 
         curOffset += mimSize;
     }
 
-    m_data.clear();
+    // m_data is kept around since the MIMs are views into it.
 }
 
 void KFMTFile::loadMIX()
@@ -120,7 +368,9 @@ void KFMTFile::loadMIX()
     // So if a MIX file is not recognized as a MIM, TIM or TMD, it does not store the
     // size for each file.
 
-    if (Utilities::fileIsTIM(m_data) || Utilities::fileIsTMD(m_data))
+    const auto firstFormat = detectedFormat();
+    if (firstFormat == Utilities::DetectedFormat::TIM
+        || firstFormat == Utilities::DetectedFormat::TMD)
         m_containerType = ContainerType::MIX_NoSizes;
     else m_containerType = ContainerType::MIX_HasSizes;
 
@@ -131,10 +381,10 @@ void KFMTFile::loadMIX()
     {
         while (curOffset < m_data.size())
         {
-            auto size = Utilities::as<uint32_t>(m_data, curOffset);
+            auto size = Utilities::as<uint32_t>(std::as_const(m_data), curOffset);
             if (size == 0) // This happens in the KF2 Game DB due to T file padding.
                 break;
-            createChild(QString::number(fileNo), m_data.mid(curOffset + 4, size));
+            createChild(QString::number(fileNo), dataView(curOffset + 4, size));
 
             curOffset += 4 + size;
             fileNo++;
@@ -144,17 +394,18 @@ void KFMTFile::loadMIX()
     {
         while (curOffset + 8 < m_data.size())
         {
-            // Get the signature for the file at the current offset.
-            auto curOffsetSignature = m_data.mid(static_cast<int>(curOffset), 8);
+            // MIMs start with their size, so the view only covers the file at the current offset
+            // if it is one. That's all the other formats need to be told apart too.
+            const auto format = Utilities::detectFormat(
+                dataView(curOffset, Utilities::as<uint32_t>(std::as_const(m_data), curOffset)));
             uint32_t size = 0;
-            if (Utilities::fileIsTIM(curOffsetSignature))
+            if (format == Utilities::DetectedFormat::TIM)
                 size = PS1::TIM(m_data, curOffset).fileSize();
-            else if (Utilities::fileIsTMD(curOffsetSignature))
+            else if (format == Utilities::DetectedFormat::TMD)
                 size = PS1::TMD(m_data, curOffset).fileSize();
-            else if (Utilities::fileIsMIM(
-                         m_data.mid(curOffset, Utilities::as<uint32_t>(curOffsetSignature))))
-                size = Utilities::as<uint32_t>(m_data, curOffset);
-            else if (Utilities::fileIsVH(curOffsetSignature))
+            else if (format == Utilities::DetectedFormat::MIM)
+                size = Utilities::as<uint32_t>(std::as_const(m_data), curOffset);
+            else if (format == Utilities::DetectedFormat::VH)
             {
                 // VABs are actually two files in a trenchcoat which are one file split into two trenchcoats.
                 // So here we manually create the subfile for the header and then leave the appropriate stuff
@@ -164,12 +415,12 @@ void KFMTFile::loadMIX()
                 auto waveformSize = vh.waveformFileSize();
                 fsmt_assert(headerSize != 0, "KFMTFile::loadMIX: VAB has empty header!");
                 fsmt_assert(waveformSize != 0, "KFMTFile::loadMIX: VAB has empty waveform!");
-                createChild(QString::number(fileNo), m_data.mid(curOffset, headerSize));
+                createChild(QString::number(fileNo), dataView(curOffset, headerSize));
                 curOffset += headerSize;
                 fileNo++;
                 size = waveformSize;
             }
-            else if (Utilities::fileIsSEQ(curOffsetSignature))
+            else if (format == Utilities::DetectedFormat::SEQ)
             {
                 KFMTError::error(QStringLiteral(u"FSMTFile::loadMIX has found a SEQ file in a "
                                                 "sizeless MIX called %1. The SEQ format is a bit"
@@ -181,13 +432,13 @@ void KFMTFile::loadMIX()
             
             fsmt_assert(size != 0, "KFMTFile::loadMIX: Calculated size for file in MIX_NoSizes is 0!");
 
-            createChild(QString::number(fileNo), m_data.mid(curOffset, size));
+            createChild(QString::number(fileNo), dataView(curOffset, size));
             curOffset += size;
             fileNo++;
         }
     }
 
-    m_data.clear();
+    // m_data is kept around since the subfiles are views into it.
 }
 
 void KFMTFile::loadT()
@@ -197,8 +448,7 @@ void KFMTFile::loadT()
     m_containerType = ContainerType::T;
     m_tFileMap = std::make_unique<std::map<uint16_t, uint16_t>>();
 
-    QDataStream stream(m_data);
-    stream.setByteOrder(QDataStream::LittleEndian);
+    BinaryReader stream(m_data);
 
     uint16_t nFiles;
     stream >> nFiles;
@@ -230,116 +480,195 @@ void KFMTFile::loadT()
         fileNum++;
     }
 
+    if (!stream.ok())
+    {
+        KFMTError::error(QStringLiteral("KFMTFile: T file %1: %2").arg(m_name, stream.errorString()));
+        return;
+    }
+
     // Multiply all offsets by 2048
     for (auto& o : offsets)
         o *= 2048u;
 
     // Preallocate the subfile vector to avoid overhead
-    //m_subFiles.reserve(trueFileNum);
+    m_subFiles.reserve(trueFileNum);
 
     // Read the files in the T file
     size_t fileNo = 0;
     for (auto fileOffset = offsets.cbegin(); fileOffset != offsets.end() - 1; fileOffset++)
     {
         createChild(QString::number(fileNo),
-                    m_data.mid(*(fileOffset), *(fileOffset + 1) - *fileOffset));
+                    dataView(*(fileOffset), *(fileOffset + 1) - *fileOffset));
         fileNo++;
     }
 }
 
-void KFMTFile::writeFile(const QDir& outDir)
+void KFMTFile::setName(const QString& name)
+{
+    if (m_parent != nullptr && m_parent->findChild(m_name) == this)
+    {
+        m_parent->m_subFileIndex.erase(QStringView(m_name));
+        m_name = name;
+        m_parent->m_subFileIndex.try_emplace(QStringView(m_name), this);
+    }
+    else
+        m_name = name;
+
+    // Cached paths through this file are stale now.
+    KFMTFile* root = this;
+    while (root->m_parent != nullptr)
+        root = root->m_parent;
+    std::lock_guard lock(root->m_pathCacheMutex);
+    root->m_pathCache.clear();
+}
+
+bool KFMTFile::tPatches(QIODevice& original, Patches& patches)
 {
-    QString dirToCreate = m_name.left(
-        m_name.lastIndexOf(QRegularExpression(QStringLiteral("[\\/]"))) + 1);
-    outDir.mkpath(dirToCreate);
+    static constexpr uint32_t sectorSize = 2048;
 
-    QFile output(outDir.filePath(m_name));
-    if (!output.open(QIODevice::WriteOnly))
-        KFMTError::fatalError("Unable to open output file for " + m_name);
+    // The file on disk has to have the layout the subfiles were split from, which is read the same
+    // way loadT does.
+    if (!original.seek(0)) return false;
+    const auto header = original.read(sectorSize);
+    if (header.size() != static_cast<int>(sectorSize)) return false;
 
-    switch (m_fileType)
+    const auto nFiles = Utilities::as<uint16_t>(header);
+    std::vector<uint32_t> offsets;
+    for (uint32_t i = 0; i <= nFiles && (i + 2) * 2 <= sectorSize; i++)
     {
-        case FileFormat::Folder:
+        const auto offset = Utilities::as<uint16_t>(header, 2 + i * 2);
+        if (offset == 0) break;
+        if (offsets.empty() || offsets.back() != offset) offsets.push_back(offset);
+    }
+    if (offsets.size() != m_subFiles.size() + 1
+        || static_cast<qint64>(offsets.back()) * sectorSize > original.size())
+        return false;
+
+    patches.clear();
+    for (size_t fileNo = 0; fileNo < m_subFiles.size(); fileNo++)
+    {
+        auto& file = *m_subFiles[fileNo];
+        if (!file.m_dirty) continue;
+
+        auto data = file.tSubFileContents();
+        const auto sectors = (static_cast<uint32_t>(data.size()) + sectorSize - 1) / sectorSize;
+        if (sectors != offsets[fileNo + 1] - offsets[fileNo]) return false;
+
+        patches.emplace_back(offsets[fileNo] * sectorSize, std::move(data));
+    }
+
+    return true;
+}
+
+bool KFMTFile::applyPatches(QFileDevice& file, const Patches& patches)
+{
+    static constexpr uint32_t sectorSize = 2048;
+    static const QByteArray zeroSector(sectorSize, '\0');
+
+    for (const auto& [offset, data] : patches)
+    {
+        const auto padding = (sectorSize - static_cast<uint32_t>(data.size()) % sectorSize)
+                             % sectorSize;
+        if (!file.seek(offset) || file.write(data) != data.size()
+            || file.write(zeroSector.constData(), padding) != padding)
         {
-            QDir dir(m_name);
-            if (!dir.exists())
-                dir.mkdir(".");
-            for (auto& file : m_subFiles)
-                file.writeFile(dir);
-            break;
+            KFMTError::error(QStringLiteral("KFMTFile::applyPatches: Unable to write to %1: %2")
+                                 .arg(file.fileName(), file.errorString()));
+            return false;
         }
-        case FileFormat::MIMList: writeMIMList(output); break;
-        case FileFormat::MIX: writeMIX(output); break;
-        case FileFormat::Raw: output.write(m_data); break;
-        case FileFormat::Root: break;
-        case FileFormat::T: writeT(output); break;
     }
 
-    output.close();
+    return true;
 }
 
-void KFMTFile::writeMIMList(QFile& fileHandle)
+void KFMTFile::writeContents(QIODevice& device)
 {
-    QDataStream outStream(&fileHandle);
+    // Containers that didn't change (or that nobody even looked into) are written as loaded.
+    if (!m_dirty || !isExpanded())
+    {
+        device.write(m_data);
+        return;
+    }
+
+    switch (m_fileType)
+    {
+        case FileFormat::MIMList: writeMIMList(device); break;
+        case FileFormat::MIX: writeMIX(device); break;
+        case FileFormat::T: writeT(device); break;
+        default: device.write(m_data); break;
+    }
+}
+
+void KFMTFile::writeMIMList(QIODevice& device)
+{
+    QDataStream outStream(&device);
     outStream.setByteOrder(QDataStream::LittleEndian);
 
     outStream << static_cast<uint32_t>(m_subFiles.size());
     for (const auto& file : m_subFiles)
-        outStream.writeRawData(file.m_data.data(), file.m_data.size());
+    {
+        const auto data = file->contents();
+        outStream.writeRawData(data.constData(), data.size());
+    }
 }
 
-void KFMTFile::writeMIX(QFile& fileHandle)
+void KFMTFile::writeMIX(QIODevice& device)
 {
-    QDataStream outStream(&fileHandle);
+    QDataStream outStream(&device);
     outStream.setByteOrder(QDataStream::LittleEndian);
 
     for (const auto& file : m_subFiles) {
+        const auto data = file->contents();
         if (m_containerType == ContainerType::MIX_HasSizes)
-            outStream << static_cast<uint32_t>(file.m_data.size());
-        outStream.writeRawData(file.m_data.data(), file.m_data.size());
+            outStream << static_cast<uint32_t>(data.size());
+        outStream.writeRawData(data.constData(), data.size());
     }
 }
 
-void KFMTFile::writeT(QFile& fileHandle)
+void KFMTFile::writeT(QIODevice& device)
 {
-    for (auto& file : m_subFiles)
-        file.recalculateChecksum();
+    static constexpr uint32_t sectorSize = 2048;
+    static const QByteArray zeroSector(sectorSize, '\0');
 
-    // Create data blob
-    QByteArray dataBlob;
+    std::vector<QByteArray> subFileContents;
+    subFileContents.reserve(m_subFiles.size());
+    for (auto& file : m_subFiles)
+        subFileContents.push_back(file->tSubFileContents());
 
+    // Work out where every file goes from their sizes, so they can be written straight to the
+    // output instead of being gathered into one big blob first. Files start on a sector boundary,
+    // right after the sector with the offset table.
     std::vector<uint16_t> newTrueOffsets;
-
-    for (const auto& file : m_subFiles) {
-        QByteArray alignedFile;
-        auto alignedSize = static_cast<uint16_t>(file.m_data.size() / 2048u);
-        if (file.m_data.size() % 2048u != 0) alignedSize += 1;
-
-        alignedFile.resize(alignedSize * 2048u);
-        alignedFile.fill(0);
-        std::memcpy(alignedFile.data(), file.m_data.data(), file.m_data.size());
-
-        newTrueOffsets.push_back((dataBlob.size() + 2048u) / 2048u);
-        dataBlob.append(file.m_data);
+    newTrueOffsets.reserve(m_subFiles.size() + 1);
+    uint32_t curSector = 1;
+    for (const auto& data : subFileContents)
+    {
+        newTrueOffsets.push_back(static_cast<uint16_t>(curSector));
+        curSector += (static_cast<uint32_t>(data.size()) + sectorSize - 1) / sectorSize;
     }
-
     // Add EOF to the offset vector
-    newTrueOffsets.push_back((dataBlob.size() + 2048u) / 2048u);
-
-    // Create stream for writing to the file
-    QDataStream outStream(&fileHandle);
-    outStream.setByteOrder(QDataStream::LittleEndian);
+    newTrueOffsets.push_back(static_cast<uint16_t>(curSector));
+    fsmt_assert(curSector <= 0xFFFF, "KFMTFile::writeT: T file is too big for its offset table!");
+
+    // Build the offset table in its sector and write it in one go.
+    QByteArray header(sectorSize, '\0');
+    const auto fileNumCount = static_cast<uint32_t>(m_tFileMap->size());
+    fsmt_assert((fileNumCount + 1) * 2 <= sectorSize,
+                "KFMTFile::writeT: T file has too many files for its offset table!");
     // Write number of (fake) files
-    outStream << static_cast<uint16_t>((*m_tFileMap).size() - 1);
-
+    Utilities::as<uint16_t>(header) = static_cast<uint16_t>(fileNumCount - 1);
     // Write pointers
-    for (size_t fileNum = 0; fileNum < (*m_tFileMap).size(); fileNum++)
-        outStream << newTrueOffsets.at((*m_tFileMap).find(fileNum)->second);
-
-    // Pad out pointer table to 2048 bytes.
-    // FIXME: I think this is pretty slow, but I can't think of a way around it right now.
-    while (outStream.device()->pos() < 2048)
-        outStream << static_cast<uint8_t>(0);
+    for (uint32_t fileNum = 0; fileNum < fileNumCount; fileNum++)
+        Utilities::as<uint16_t>(header, 2 + fileNum * 2)
+            = newTrueOffsets.at(m_tFileMap->find(static_cast<uint16_t>(fileNum))->second);
+    device.write(header);
 
-    outStream.writeRawData(dataBlob.data(), dataBlob.size());
+    // Then every file, padded out to the next sector.
+    for (const auto& data : subFileContents)
+    {
+        device.write(data.constData(), data.size());
+        const auto padding = (sectorSize - static_cast<uint32_t>(data.size()) % sectorSize)
+                             % sectorSize;
+        if (padding != 0) device.write(zeroSector.constData(), padding);
+    }
 }
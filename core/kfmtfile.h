@@ -3,12 +3,41 @@
 
 #include "core/kfmterror.h"
 #include <QDir>
+#include <QFileDevice>
+#include <QIODevice>
 #include <QRegularExpression>
 #include <QStringView>
+#include <atomic>
+#include <functional>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <vector>
 
 struct KFMTFileListEntry;
 
+namespace Utilities
+{
+enum class DetectedFormat : uint8_t;
+}
+
+/*!
+ * \brief Hash and equality for maps keyed by file names or paths.
+ * They are transparent, so maps with QString keys can be searched with a QStringView.
+ */
+struct KFMTFileNameHash
+{
+    using is_transparent = void;
+    size_t operator()(QStringView name) const { return qHash(name); }
+};
+
+struct KFMTFileNameEqual
+{
+    using is_transparent = void;
+    bool operator()(QStringView lhs, QStringView rhs) const { return lhs == rhs; }
+};
+
 class KFMTFile
 {
 public:
@@ -85,37 +114,120 @@ public:
     /*!
      * \brief Method to extract files from a container onto a directory.
      * \param outDir Directory which to extract files to.
+     * \return Whether every file was written. Files that couldn't be are reported and skipped.
      */
-    void extractTo(const QDir& outDir);
+    bool extractTo(const QDir& outDir);
 
     /*!
      * \brief Returns child count for containers.
+     * Splits the container first if that hasn't happened yet.
      */
-    [[nodiscard]] inline uint32_t childCount() const { return static_cast<uint32_t>(m_subFiles.size()); }
+    [[nodiscard]] inline uint32_t childCount()
+    {
+        expand();
+        return static_cast<uint32_t>(m_subFiles.size());
+    }
 
     inline void createChild(const QString& name, const QByteArray& data,
                             const FileFormat fileType = FileFormat::Raw,
                             const DataType dataType = DataType::Unknown,
                             const QString& prettyName = "")
     {
-        m_subFiles.emplace_back(name, data, this, fileType, dataType, prettyName);
+        addChild(std::make_unique<KFMTFile>(name, data, this, fileType, dataType, prettyName));
     }
 
+    /*!
+     * \brief Tells the file that its data has been written to.
+     * Editors call this when they change a file. It recomputes anything cached from the data and
+     * marks the file and every container above it as dirty, so they are written on the next save.
+     */
+    void dataChanged();
+
     /*!
      * \brief Gets this file's data type.
      */
     [[nodiscard]] inline DataType dataType() const { return m_dataType; }
 
+    /*!
+     * \brief Splits a container into its subfiles, if it hasn't been split yet.
+     * T, MIX and MIM list containers only record their format on construction. Their table of
+     * contents is parsed the first time their children are asked for, which happens through this
+     * method. It is thread-safe and does the actual work at most once.
+     */
+    void expand();
+
+    /*!
+     * \brief Detects the format of this file's data.
+     * The result is cached until the data is written to, or replaced by loading or saving it.
+     */
+    [[nodiscard]] Utilities::DetectedFormat detectedFormat() const;
+
     /*!
      * \brief Returns an appropriate extension for the file.
      */
     [[nodiscard]] const QString& extension() const;
 
+    /*!
+     * \brief Reads this file's data, if reading it was deferred until something needs it.
+     * Files in disc images that aren't split when loading are only read once they're used. Anything
+     * that reads m_data of a file that isn't a subfile has to call this first. Data handlers do in
+     * their constructor. It is thread-safe and reads the data at most once.
+     */
+    void loadData();
+
     /*!
      * \brief Gets this file's format.
      */
     [[nodiscard]] inline FileFormat format() const { return m_fileType; }
 
+    /*!
+     * \brief Gets this file's index among its parent's children.
+     */
+    [[nodiscard]] inline uint32_t indexInParent() const { return m_index; }
+
+    /*!
+     * \brief Whether this file has changed since it was loaded or last saved to its source.
+     * Containers are dirty when any file inside them is.
+     */
+    [[nodiscard]] inline bool isDirty() const { return m_dirty; }
+
+    /*!
+     * \brief Marks this file and everything inside it as saved to the source.
+     * What they have now becomes what clearUnchanged and contentHash() look at.
+     */
+    void clearDirty();
+
+    /*!
+     * \brief Clears the dirty flag of files that are back to what they were loaded as.
+     * Editors mark files dirty even if nothing was actually changed. Files are compared against
+     * the data they were loaded with, which they share until they're written to, so files nobody
+     * wrote to aren't read.
+     * \return Whether this file is still dirty.
+     */
+    bool clearUnchanged();
+
+    /*!
+     * \brief Hash of this file's contents as it was loaded or last saved to the source, see
+     * Utilities::contentHash.
+     * It's only computed the first time it's asked for, so loading doesn't read every file. Files
+     * whose data was deferred have to be loaded first, see loadData().
+     */
+    [[nodiscard]] uint64_t contentHash() const;
+
+    /*!
+     * \brief Whether this T file subfile was loaded with a checksum that doesn't match its data.
+     * Only set for T files loaded from the source directory. Saving the file fixes its checksum.
+     */
+    [[nodiscard]] inline bool hasBadChecksum() const { return m_badChecksum; }
+
+    /*!
+     * \brief Whether this file's children (if any) have been loaded.
+     */
+    [[nodiscard]] inline bool isExpanded() const
+    {
+        return m_expanded.load(std::memory_order_acquire);
+    }
+
     /*!
      * \brief Gets this file's name.
      */
@@ -127,6 +239,11 @@ public:
     [[nodiscard]] inline const KFMTFile* parent() const { return m_parent; }
 
     [[nodiscard]] inline KFMTFile* parent() { return m_parent; }
+
+    /*!
+     * \brief Gets this file's path from the root, e.g. "CD/COM/FDAT.T/28".
+     */
+    [[nodiscard]] QString path() const;
     
     [[nodiscard]] inline const QString& prettyName() const
     {
@@ -137,7 +254,10 @@ public:
     inline void resetRoot()
     {
         fsmt_assert(dataType() == DataType::Root, "KFMTFile::resetRoot: Called for non-root file!");
+        m_subFileIndex.clear();
         m_subFiles.clear();
+        std::lock_guard lock(m_pathCacheMutex);
+        m_pathCache.clear();
     }
 
     /*!
@@ -148,26 +268,23 @@ public:
 
     /*!
      * \brief Setter for the file format.
+     * Containers are not split here, see expand(). Files that were already split keep their
+     * subfiles, and aren't split again.
      * \param fileFormat New file format.
      */
     inline void setFileFormat(const FileFormat fileFormat)
     {
+        std::lock_guard lock(m_expandMutex);
+        const bool resplit = fileFormat != m_fileType && m_subFiles.empty();
         m_fileType = fileFormat;
-        
-        switch (fileFormat)
-        {
-            case FileFormat::MIMList: loadMIMList(); break;
-            case FileFormat::MIX: loadMIX(); break;
-            case FileFormat::T: loadT(); break;
-            default: break;
-        }
+        if (resplit) m_expanded.store(!isSplitFormat(fileFormat), std::memory_order_release);
     }
 
     /*!
      * \brief Setter for the file name.
      * \param name New file name.
      */
-    inline void setName(const QString& name) { m_name = name; }
+    void setName(const QString& name);
 
     /*!
      * \brief Setter for the pretty name.
@@ -175,50 +292,31 @@ public:
      */
     inline void setPrettyName(const QString& prettyName) { m_prettyName = prettyName; }
 
-    /*!
-     * \brief Writes the file to a given output directory.
-     * \param outDir Output directory
-     */
-    void writeFile(const QDir& outDir);
-
     [[nodiscard]] KFMTFile* operator[](size_t index)
     {
+        expand();
         if (index >= m_subFiles.size()) return nullptr;
-        auto i = m_subFiles.begin();
-        std::advance(i, index);
-        return &*i;
+        return m_subFiles[index].get();
     }
 
-    [[nodiscard]] KFMTFile* operator[](const QStringView& name)
-    {
-        QList<QStringView> pathTree {name};
-        if (name.contains('/'))
-            pathTree = name.split('/');
-        
-        KFMTFile* result = this;
-        for (auto& level : pathTree)
-        {
-            KFMTFile* old = result;
-            for (auto& file : result->m_subFiles)
-                if (file.m_name == level)
-                {
-                    result = &file;
-                    break;
-                }
-            if (result == old) // If we didn't find this level, we bail
-                return nullptr;
-        }
-        
-        if (result == this)
-            return nullptr;
-        
-        return result;
-    }
+    /*!
+     * \brief Looks up a file by its path relative to this one, splitting containers on the way.
+     * Lookups through the root are cached, so editors can look up the same files over and over.
+     * \param path Path with its levels separated by '/', e.g. "CD/COM/RTMD.T/3".
+     * \return The file, or nullptr if there is none at that path.
+     */
+    [[nodiscard]] KFMTFile* operator[](const QStringView& path);
 
 private:
     QString m_name;
 
 public:
+    /*!
+     * \brief The file's data.
+     * When loaded with KFMTCore::LoadMode::MemoryMapped this doesn't own its bytes. Read it through
+     * const access (constData(), const references) whenever possible, since any non-const access
+     * detaches it into a full copy.
+     */
     QByteArray m_data;
 
 private:
@@ -229,25 +327,145 @@ private:
 
 private:
     /*!
-     * \brief Calculates and writes the checksum to a file.
+     * \brief Constructor for subfiles rebuilt from a ProjectIndex, which are split from it already.
+     */
+    KFMTFile(const QString& name, const QByteArray& data, KFMTFile* const parent,
+             const DataType dataType);
+
+    /*!
+     * \brief Sets the data this file was loaded with, which is also what it's compared against.
+     * \param contentHash Its hash, if that's already known.
+     */
+    void setLoadedData(const QByteArray& data, std::optional<uint64_t> contentHash = std::nullopt);
+
+    /*!
+     * \brief Defers reading this file's data to the first loadData() call.
+     * Until then m_data is empty.
+     * \param loader Reads the data. It's called at most once, and dropped afterwards.
+     */
+    inline void deferData(std::function<QByteArray()> loader) { m_dataLoader = std::move(loader); }
+
+    inline void addChild(std::unique_ptr<KFMTFile> file)
+    {
+        auto& child = *m_subFiles.emplace_back(std::move(file));
+        child.m_index = static_cast<uint32_t>(m_subFiles.size() - 1);
+        // The first file with a name is the one lookups find, so duplicates don't replace it.
+        m_subFileIndex.try_emplace(QStringView(child.m_name), &child);
+    }
+
+    /*!
+     * \brief Calculates and writes the checksum to a file's data.
      * THIS SHOULD ONLY BE RUN FOR T FILE SUBFILES.
      */
-    void recalculateChecksum();
+    static void recalculateChecksum(QByteArray& data);
+
+    /*!
+     * \brief Sets hasBadChecksum() from the data. Only meaningful for T file subfiles.
+     */
+    void verifyChecksum();
+
+    /*!
+     * \brief Returns the bytes this file would be saved as.
+     * That's m_data, unless this is a split container which changed, which is rebuilt from its
+     * subfiles.
+     */
+    [[nodiscard]] QByteArray contents();
+
+    /*!
+     * \brief Data to write over a T file, as (offset, unpadded data) pairs.
+     */
+    using Patches = std::vector<std::pair<uint32_t, QByteArray>>;
+
+    /*!
+     * \brief Works out how to patch the dirty subfiles of a T container into a copy of it.
+     * Nothing is written, so every file of a save can be prepared before any of them changes.
+     * \param original Copy of this T file on disk, open for reading.
+     * \param patches Receives the patches.
+     * \return Whether the copy can be patched, i.e. it has the layout this file was split from and
+     * every dirty subfile still fits in its sectors.
+     */
+    bool tPatches(QIODevice& original, Patches& patches);
+
+    /*!
+     * \brief Writes patches from tPatches to a file open for writing, padding them to sectors.
+     */
+    static bool applyPatches(QFileDevice& file, const Patches& patches);
+
+    /*!
+     * \brief Returns contents() with a new checksum if the file changed, for T subfiles.
+     */
+    [[nodiscard]] QByteArray tSubFileContents();
+
+    /*!
+     * \brief Writes contents() to a device, without building it in memory for T files.
+     */
+    void writeContents(QIODevice& device);
+
+    /*!
+     * \brief Returns a non-owning view of a range of this file's data.
+     * Container children are made from these, so their data shares the parent's buffer (or its
+     * mapping) until it is written to. The parent's m_data must therefore be left untouched while
+     * it has children.
+     * \param offset Offset of the range.
+     * \param size Size of the range. Clamped to the end of the data.
+     */
+    [[nodiscard]] QByteArray dataView(uint32_t offset, uint32_t size) const;
+
+    /*!
+     * \brief Gives this file and everything inside it copies of their data.
+     * Afterwards nothing under it points into its source's mapping or its parent's buffer, so the
+     * source can be unmapped and replaced, and this file's m_data can be replaced too. Files that
+     * were written to already have their own copy, which is kept.
+     */
+    void ownData();
+
+    /*!
+     * \brief Finds a direct child by name, without splitting this file first.
+     */
+    [[nodiscard]] KFMTFile* findChild(QStringView name) const;
+
+    /*!
+     * \brief Whether files of a given format are containers split into subfiles from their data.
+     */
+    static constexpr bool isSplitFormat(const FileFormat format)
+    {
+        return format == FileFormat::MIMList || format == FileFormat::MIX
+               || format == FileFormat::T;
+    }
+
+    /*!
+     * \brief Applies the file list entries deferred to this container to its new children.
+     * Entries for grandchildren are passed down to the matching child.
+     */
+    void applyDeferredEntries();
 
     void loadMIMList();
     void loadMIX();
     void loadT();
-    void writeMIMList(QFile& fileHandle);
-    void writeMIX(QFile& fileHandle);
-    void writeT(QFile& fileHandle);
+    void writeMIMList(QIODevice& device);
+    void writeMIX(QIODevice& device);
+    void writeT(QIODevice& device);
 
     // Container specific stuff
     ContainerType m_containerType;
     // This used to be a std::vector but now that files have pointers to their parents, a realloc on
     // insertion would make a file's paren pointer stale. This was causing a crash as soon as one
-    // would try to expand the CD folder in KF2J. Now we use list which should have a negligible
-    // performance loss in this case and doesn't cause reallocs, keeping the parent pointers valid.
-    std::list<KFMTFile> m_subFiles; ///< List of subfiles if this file is a container
+    // would try to expand the CD folder in KF2J. It was then a list, which kept them valid but made
+    // indexing (which FileListModel does for every visible row) linear. Now the vector holds
+    // pointers, so files never move on a realloc but can still be indexed in constant time.
+    std::vector<std::unique_ptr<KFMTFile>> m_subFiles; ///< Subfiles if this file is a container
+    uint32_t m_index = 0; ///< Index of this file in its parent's m_subFiles
+    /*!
+     * \brief Index of m_subFiles by name.
+     * Keys are views into the children's m_name, so setName has to re-key its entry.
+     */
+    std::unordered_map<QStringView, KFMTFile*, KFMTFileNameHash, KFMTFileNameEqual> m_subFileIndex;
+    /*!
+     * \brief Results of path lookups through this file. Only used by the root.
+     * Files are never removed except by resetRoot, so only found files are cached.
+     */
+    std::unordered_map<QString, KFMTFile*, KFMTFileNameHash, KFMTFileNameEqual> m_pathCache;
+    std::mutex m_pathCacheMutex;
     /*!
      * \brief Maps a T file's original file numbers to the true file numbers.
      * This is necessary because T files usually have many file numbers that point to the same
@@ -256,11 +474,51 @@ private:
      * "duplicate order" as the original.
      */
     std::unique_ptr<std::map<uint16_t, uint16_t>> m_tFileMap;
+    /*!
+     * \brief File list entries for files inside this container, while it hasn't been split yet.
+     * Their paths are relative to this file.
+     */
+    std::vector<KFMTFileListEntry> m_deferredEntries;
+    /*!
+     * \brief Cached result of detectedFormat().
+     * Only used while m_data still shares its buffer with m_sourceData, i.e. nothing wrote to it
+     * since it was loaded or saved. Replacing either of them has to reset m_detectedFormatValid.
+     */
+    mutable Utilities::DetectedFormat m_detectedFormat;
+    mutable bool m_detectedFormatValid = false;
+    bool m_dirty = false;
+    /*!
+     * \brief m_data as it was loaded or last saved to the source.
+     * It shares m_data's buffer (or mapping), so it costs nothing until m_data is written to and
+     * detaches. clearUnchanged compares against it, and contentHash() hashes it.
+     */
+    QByteArray m_sourceData;
+    mutable std::optional<uint64_t> m_contentHash; ///< Cached contentHash(), if it was computed.
+    std::function<QByteArray()> m_dataLoader; ///< See deferData.
+    std::once_flag m_loadOnce;
+    bool m_badChecksum = false;
+    std::atomic<bool> m_expanded;
+    std::mutex m_expandMutex;
 
     // FileListModel needs access to the subFiles member.
     friend class FileListModel;
     // KFMTCore needs to be able to force set data and file types.
     friend class KFMTCore;
+    // Benchmarks time writeT and look at the subfiles it split.
+    friend class Benchmarks;
+    // ProjectIndex records split containers and rebuilds them without reading their data.
+    friend class ProjectIndex;
+};
+
+/*!
+ * \brief File list entry for a file inside a container which hasn't been split yet.
+ */
+struct KFMTFileListEntry
+{
+    QStringView path; ///< Path relative to the deferring container. Points into the file list.
+    KFMTFile::FileFormat format;
+    KFMTFile::DataType dataType;
+    QString prettyName;
 };
 
 #endif // KFMTFILE_H
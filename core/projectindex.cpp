@@ -0,0 +1,200 @@
+#include "projectindex.h"
+#include <QSaveFile>
+#include <cstring>
+
+static constexpr char indexMagic[8] = {'F', 'S', 'M', 'T', 'I', 'D', 'X', '\0'};
+
+bool ProjectIndex::open(const QString& path)
+{
+    m_header = nullptr;
+    m_file.setFileName(path);
+    if (!m_file.open(QIODevice::ReadOnly)) return false;
+
+    const auto size = m_file.size();
+    if (size < static_cast<qint64>(sizeof(Header))) return false;
+    const auto* data = m_file.map(0, size);
+    if (data == nullptr) return false;
+
+    const auto* header = reinterpret_cast<const Header*>(data);
+    if (std::memcmp(header->magic, indexMagic, sizeof(indexMagic)) != 0
+        || header->version != version)
+        return false;
+
+    const auto expectedSize = sizeof(Header) + quint64(header->sourceCount) * sizeof(Source)
+                              + quint64(header->nodeCount) * sizeof(Node)
+                              + quint64(header->tMapEntryCount) * sizeof(TMapEntry);
+    if (expectedSize != static_cast<quint64>(size)) return false;
+
+    m_sources = reinterpret_cast<const Source*>(data + sizeof(Header));
+    m_nodes = reinterpret_cast<const Node*>(m_sources + header->sourceCount);
+    m_tMap = reinterpret_cast<const TMapEntry*>(m_nodes + header->nodeCount);
+    m_header = header;
+    return true;
+}
+
+qint64 ProjectIndex::findSource(const QString& path, qint64 size, qint64 modified) const
+{
+    if (m_header == nullptr) return -1;
+
+    const auto pathHash = Utilities::contentHash(path.toUtf8());
+    for (uint32_t sourceNo = 0; sourceNo < m_header->sourceCount; sourceNo++)
+    {
+        const auto& source = m_sources[sourceNo];
+        if (source.pathHash != pathHash) continue;
+        if (source.size != size || source.modified != modified || !validNode(source.node))
+            return -1;
+        return source.node;
+    }
+
+    return -1;
+}
+
+void ProjectIndex::restore(KFMTFile& file, uint32_t nodeNo) const
+{
+    if (!validNode(nodeNo)) return;
+    const auto& node = m_nodes[nodeNo];
+
+    if ((node.flags & Node::Hashed) != 0) file.m_contentHash = node.contentHash;
+    file.m_badChecksum = (node.flags & Node::BadChecksum) != 0;
+    file.m_detectedFormat = node.detectedFormat;
+    file.m_detectedFormatValid = true;
+
+    // The file lists may have changed what this file is since the index was written. It's only
+    // split from the index if it's still the same kind of container.
+    if ((node.flags & Node::Expanded) == 0 || node.format != file.format()
+        || !KFMTFile::isSplitFormat(node.format))
+        return;
+    if (quint64(node.firstChild) + node.childCount > m_header->nodeCount
+        || quint64(node.tMapFirst) + node.tMapCount > m_header->tMapEntryCount)
+        return;
+
+    {
+        std::lock_guard lock(file.m_expandMutex);
+        if (file.m_expanded.load(std::memory_order_relaxed)) return;
+
+        restoreChildren(file, node);
+        file.applyDeferredEntries();
+        file.m_expanded.store(true, std::memory_order_release);
+    }
+
+    for (uint32_t childNo = 0; childNo < node.childCount; childNo++)
+        restore(*file.m_subFiles[childNo], node.firstChild + childNo);
+}
+
+void ProjectIndex::restoreChildren(KFMTFile& file, const Node& node) const
+{
+    file.m_containerType = node.containerType;
+    // Same as the loaders: MIMs are the only files whose data type comes from their container.
+    const auto dataType = node.containerType == KFMTFile::ContainerType::MIMList
+                              ? KFMTFile::DataType::Model
+                              : KFMTFile::DataType::Unknown;
+
+    file.m_subFiles.reserve(node.childCount);
+    for (uint32_t childNo = 0; childNo < node.childCount; childNo++)
+    {
+        const auto& child = m_nodes[node.firstChild + childNo];
+        file.addChild(std::unique_ptr<KFMTFile>(new KFMTFile(QString::number(childNo),
+                                                             file.dataView(child.offset, child.size),
+                                                             &file,
+                                                             dataType)));
+    }
+
+    if (node.containerType == KFMTFile::ContainerType::T)
+    {
+        file.m_tFileMap = std::make_unique<std::map<uint16_t, uint16_t>>();
+        for (uint32_t entryNo = 0; entryNo < node.tMapCount; entryNo++)
+        {
+            const auto& entry = m_tMap[node.tMapFirst + entryNo];
+            file.m_tFileMap->emplace(entry.fileNumber, entry.trueFileNumber);
+        }
+    }
+}
+
+bool ProjectIndex::write(const QString& path, const std::vector<SourceEntry>& sources)
+{
+    std::vector<Source> sourceRecords;
+    std::vector<Node> nodes;
+    std::vector<TMapEntry> tMap;
+    sourceRecords.reserve(sources.size());
+
+    for (const auto& source : sources)
+    {
+        const auto nodeNo = static_cast<uint32_t>(nodes.size());
+        sourceRecords.push_back(
+            {Utilities::contentHash(source.path.toUtf8()), source.size, source.modified, nodeNo, 0});
+        nodes.emplace_back();
+        if (!addNode(*source.file, nullptr, nodeNo, nodes, tMap)) return false;
+    }
+
+    Header header {};
+    std::memcpy(header.magic, indexMagic, sizeof(indexMagic));
+    header.version = version;
+    header.sourceCount = static_cast<uint32_t>(sourceRecords.size());
+    header.nodeCount = static_cast<uint32_t>(nodes.size());
+    header.tMapEntryCount = static_cast<uint32_t>(tMap.size());
+
+    QSaveFile output(path);
+    if (!output.open(QIODevice::WriteOnly)) return false;
+    output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    output.write(reinterpret_cast<const char*>(sourceRecords.data()),
+                 static_cast<qint64>(sourceRecords.size() * sizeof(Source)));
+    output.write(reinterpret_cast<const char*>(nodes.data()),
+                 static_cast<qint64>(nodes.size() * sizeof(Node)));
+    output.write(reinterpret_cast<const char*>(tMap.data()),
+                 static_cast<qint64>(tMap.size() * sizeof(TMapEntry)));
+    return output.commit();
+}
+
+bool ProjectIndex::addNode(const KFMTFile& file, const KFMTFile* parent, uint32_t nodeNo,
+                           std::vector<Node>& nodes, std::vector<TMapEntry>& tMap)
+{
+    if (file.m_dirty) return false;
+
+    Node node {};
+    // Files are only hashed when something needs it, and writing the index isn't reason enough.
+    if (file.m_contentHash)
+    {
+        node.contentHash = *file.m_contentHash;
+        node.flags |= Node::Hashed;
+    }
+    node.size = static_cast<uint32_t>(file.m_data.size());
+    node.format = file.m_fileType;
+    node.detectedFormat = file.detectedFormat();
+    if (file.m_badChecksum) node.flags |= Node::BadChecksum;
+
+    // Subfiles are views into their parent, so their offset is where the view starts.
+    if (parent != nullptr)
+    {
+        const auto offset = file.m_data.constData() - parent->m_data.constData();
+        if (!file.m_data.isEmpty()
+            && (offset < 0 || offset + file.m_data.size() > parent->m_data.size()))
+            return false;
+        node.offset = file.m_data.isEmpty() ? 0 : static_cast<uint32_t>(offset);
+    }
+
+    if (file.isExpanded() && KFMTFile::isSplitFormat(file.m_fileType))
+    {
+        node.flags |= Node::Expanded;
+        node.containerType = file.m_containerType;
+        node.firstChild = static_cast<uint32_t>(nodes.size());
+        node.childCount = static_cast<uint32_t>(file.m_subFiles.size());
+        nodes.resize(nodes.size() + file.m_subFiles.size());
+
+        if (file.m_tFileMap)
+        {
+            node.tMapFirst = static_cast<uint32_t>(tMap.size());
+            node.tMapCount = static_cast<uint32_t>(file.m_tFileMap->size());
+            for (const auto& [fileNumber, trueFileNumber] : *file.m_tFileMap)
+                tMap.push_back({fileNumber, trueFileNumber});
+        }
+
+        for (uint32_t childNo = 0; childNo < node.childCount; childNo++)
+        {
+            if (!addNode(*file.m_subFiles[childNo], &file, node.firstChild + childNo, nodes, tMap))
+                return false;
+        }
+    }
+
+    nodes[nodeNo] = node;
+    return true;
+}
@@ -0,0 +1,136 @@
+#ifndef PROJECTINDEX_H
+#define PROJECTINDEX_H
+
+#include "core/kfmtfile.h"
+#include "utilities.h"
+#include <QFile>
+#include <QString>
+#include <vector>
+
+/*!
+ * \brief On-disk index of a loaded game, so reopening it doesn't have to split every file.
+ * It records, for every source file, its size and modification time, where the files split out of
+ * it are, the T file duplicate maps, bad checksums, detected formats and the content hashes of the
+ * files that were hashed. Sources that still match can then be rebuilt from the index without
+ * touching their data, which stays mapped until something reads it.
+ *
+ * The index is a flat little-endian file that's memory-mapped and read in place: a Header, then
+ * Header::sourceCount Source records, Header::nodeCount Node records and Header::tMapEntryCount
+ * TMapEntry records. The children of a node are stored next to each other, so any node can be
+ * found without walking the ones before it.
+ */
+class ProjectIndex
+{
+public:
+    static constexpr uint32_t version = 1;
+
+    struct Header
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t sourceCount;
+        uint32_t nodeCount;
+        uint32_t tMapEntryCount;
+    };
+
+    struct Source
+    {
+        uint64_t pathHash; ///< Utilities::contentHash of the UTF-8 path, relative to the source.
+        qint64 size;
+        qint64 modified;   ///< Modification time in ms since the epoch.
+        uint32_t node;     ///< Node of the file itself.
+        uint32_t reserved;
+    };
+
+    struct Node
+    {
+        enum Flags : uint8_t
+        {
+            Expanded = 1,    ///< The children were split out, starting at firstChild.
+            BadChecksum = 2, ///< See KFMTFile::hasBadChecksum.
+            Hashed = 4       ///< contentHash is set.
+        };
+
+        uint64_t contentHash; ///< Only set if the file was hashed before the index was written.
+        uint32_t offset; ///< Offset of the data in the parent's data.
+        uint32_t size;
+        uint32_t firstChild;
+        uint32_t childCount;
+        uint32_t tMapFirst;
+        uint32_t tMapCount;
+        KFMTFile::FileFormat format; ///< Format the file was split as. Only meaningful if expanded.
+        KFMTFile::ContainerType containerType;
+        Utilities::DetectedFormat detectedFormat;
+        uint8_t flags;
+        uint32_t reserved;
+    };
+
+    struct TMapEntry
+    {
+        uint16_t fileNumber;
+        uint16_t trueFileNumber;
+    };
+
+    static_assert(sizeof(Header) == 24 && sizeof(Source) == 32 && sizeof(Node) == 40
+                      && sizeof(TMapEntry) == 4,
+                  "The index layout must not depend on the compiler.");
+
+    /*!
+     * \brief Maps an index file and checks that it is complete.
+     * \return Whether it can be used. Missing, truncated and old indexes are all just unusable.
+     */
+    bool open(const QString& path);
+
+    /*!
+     * \brief Finds the node of a source file, if the index has one for it and it didn't change.
+     * \param path Path relative to the source, like the file lists have it.
+     * \return Node index, or -1.
+     */
+    [[nodiscard]] qint64 findSource(const QString& path, qint64 size, qint64 modified) const;
+
+    /*!
+     * \brief Rebuilds a source file from its node: its content hash if it has one, and if it was
+     * split and is still a container of the same format, its children, recursively.
+     * The file's data must already be set, and be the data the index was written for.
+     */
+    void restore(KFMTFile& file, uint32_t node) const;
+
+    /*!
+     * \brief Source file to write into an index.
+     */
+    struct SourceEntry
+    {
+        QString path;
+        qint64 size;
+        qint64 modified;
+        KFMTFile* file;
+    };
+
+    /*!
+     * \brief Writes an index for the given source files and everything split out of them.
+     * Formats are detected for every file that wasn't yet, so reopening doesn't have to.
+     * \return Whether it was written. Failures aren't errors, the index is just a cache.
+     */
+    static bool write(const QString& path, const std::vector<SourceEntry>& sources);
+
+private:
+    /*!
+     * \brief Adds a file and everything split out of it to the node arrays.
+     * \return Whether it could be, i.e. nothing in it changed since it was loaded.
+     */
+    static bool addNode(const KFMTFile& file, const KFMTFile* parent, uint32_t nodeNo,
+                        std::vector<Node>& nodes, std::vector<TMapEntry>& tMap);
+    void restoreChildren(KFMTFile& file, const Node& node) const;
+    [[nodiscard]] bool validNode(uint32_t node) const
+    {
+        return m_header != nullptr && node < m_header->nodeCount;
+    }
+
+    QFile m_file;
+    const Header* m_header = nullptr;
+    const Source* m_sources = nullptr;
+    const Node* m_nodes = nullptr;
+    const TMapEntry* m_tMap = nullptr;
+};
+
+#endif // PROJECTINDEX_H
@@ -6,7 +6,7 @@
 class KFMTDataHandler
 {
 public:
-    explicit KFMTDataHandler(KFMTFile& file_) : file(file_) {}
+    explicit KFMTDataHandler(KFMTFile& file_) : file(file_) { file.loadData(); }
     virtual ~KFMTDataHandler(){};
     KFMTFile& getFile() { return file; }
     virtual void saveChanges() = 0;
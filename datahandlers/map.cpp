@@ -1,36 +1,38 @@
 #include "map.h"
+#include "core/binaryreader.h"
 #include "utilities.h"
-#include <QDataStream>
 
 Map::Map(KFMTFile& file1, KFMTFile& file2, KFMTFile& file3)
     : KFMTDataHandler(file1), mapDB(file2), mapScript(file3)
 {
     tileMap = &Utilities::as<KF2::MetaTile>(file.m_data, 4);
 
-    QDataStream mapDBStream(mapDB.m_data);
-    mapDBStream.setByteOrder(QDataStream::LittleEndian);
+    BinaryReader mapDBStream(mapDB.m_data);
     uint32_t sectionSize;
 
     mapDBStream >> sectionSize; // Read entity class declaration + state info section size
     entityClasses = &Utilities::as<KF2::EntityClass>(mapDB.m_data,
-                                                              mapDBStream.device()->pos());
-    mapDBStream.skipRawData(sectionSize);
+                                                              mapDBStream.pos());
+    mapDBStream.skip(sectionSize);
 
     entityStateBlob = reinterpret_cast<uint8_t*>(entityClasses + entityClassesSize);
 
     mapDBStream >> sectionSize; // Read entity instance declaration section size
     entityInstances = &Utilities::as<KF2::EntityInstance>(mapDB.m_data,
-                                                                   mapDBStream.device()->pos());
-    mapDBStream.skipRawData(sectionSize);
+                                                                   mapDBStream.pos());
+    mapDBStream.skip(sectionSize);
 
     mapDBStream >> sectionSize; // Read object instance declaration section size
     objectInstances = &Utilities::as<KF2::ObjectInstance>(mapDB.m_data,
-                                                                   mapDBStream.device()->pos());
-    mapDBStream.skipRawData(sectionSize);
+                                                                   mapDBStream.pos());
+    mapDBStream.skip(sectionSize);
 
     mapDBStream >> sectionSize; // Read VFX instance declaration section size
-    vfxInstances = &Utilities::as<KF2::VFX>(mapDB.m_data, mapDBStream.device()->pos());
-    mapDBStream.skipRawData(sectionSize);
+    vfxInstances = &Utilities::as<KF2::VFX>(mapDB.m_data, mapDBStream.pos());
+    mapDBStream.skip(sectionSize);
+
+    if (!mapDBStream.ok())
+        KFMTError::error(QStringLiteral("Map: Map DB: %1").arg(mapDBStream.errorString()));
 }
 
 std::vector<KF2::EntityInstance*> Map::entitiesAt(uint8_t x, uint8_t y, uint8_t layer)
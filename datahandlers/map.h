@@ -64,7 +64,14 @@ public:
         return vfxInstances[instanceIndex];
     }
 
-    void saveChanges() override {}
+    /*!
+     * \brief The map is edited in place, so this only marks the other two files as changed.
+     */
+    void saveChanges() override
+    {
+        mapDB.dataChanged();
+        mapScript.dataChanged();
+    }
 
     // Convenience methods
     std::vector<KF2::EntityInstance*> entitiesAt(uint8_t x, uint8_t y, uint8_t layer);
@@ -2,64 +2,120 @@
 #include "core/kfmtcore.h"
 #include "core/kfmterror.h"
 #include "utilities.h"
+#include <algorithm>
 #include <iostream>
+#include <QTextStream>
 #include <QVector2D>
 
-Model::Model(KFMTFile& modelFile) : KFMTDataHandler(modelFile)
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define FSMT_SVECTOR_SSE2
+#endif
+
+Model::Model(KFMTFile& modelFile)
+    : KFMTDataHandler(modelFile),
+      m_fileData(modelFile.m_data.constData(), modelFile.m_data.size())
 {
-    if (core.currentGame() == KFMTCore::SimpleGame::KF1 && Utilities::fileIsMIM(modelFile.m_data))
-        loadMIM(modelFile.m_data);
-    else if (Utilities::fileIsMO(modelFile.m_data))
-        loadMO(modelFile.m_data);
-    else if (Utilities::fileIsRTMD(modelFile.m_data))
-        loadRTMD(modelFile.m_data);
-    else if (Utilities::fileIsTMD(modelFile.m_data))
-        loadTMD(modelFile.m_data);
+    if (core.currentGame() == KFMTCore::SimpleGame::KF1 && Utilities::fileIsMIM(m_fileData))
+        loadMIM(m_fileData);
+    else if (Utilities::fileIsMO(m_fileData))
+        loadMO(m_fileData);
+    else if (Utilities::fileIsRTMD(m_fileData))
+        loadRTMD(m_fileData);
+    else if (Utilities::fileIsTMD(m_fileData))
+        loadTMD(m_fileData);
     else
         KFMTError::error(QStringLiteral("Model: Tried to make a model from an unknown file type."));
 }
 
-void Model::fixShiftedIndices()
+Model::~Model()
+{
+    // Prefetches that haven't started yet aren't needed anymore.
+    m_prefetchPool.clear();
+    m_prefetchPool.waitForDone();
+}
+
+size_t Model::writeOBJ(QIODevice& output)
+{
+    QTextStream obj(&output);
+    size_t faceCount = 0;
+    size_t vertexOffset = 1; // OBJ indices start at 1 and are shared by every object
+    for (size_t objectNo = 0; objectNo < baseObjects.size(); objectNo++)
+    {
+        const auto& mesh = object(objectNo);
+        obj << "o Object" << objectNo << '\n';
+        for (size_t i = 0; i < mesh.vertices.size(); i++)
+            obj << "v " << mesh.vertices.x[i] << ' ' << mesh.vertices.y[i] << ' '
+                << mesh.vertices.z[i] << '\n';
+
+        const auto vertexCount = mesh.vertices.size();
+        for (const auto& prim : mesh.primitives)
+        {
+            if (prim.isTriangle())
+            {
+                if (std::max({prim.vertex0, prim.vertex1, prim.vertex2}) >= vertexCount) continue;
+                obj << "f " << vertexOffset + prim.vertex0 << ' ' << vertexOffset + prim.vertex1
+                    << ' ' << vertexOffset + prim.vertex2 << '\n';
+            }
+            else if (prim.isQuad())
+            {
+                if (std::max({prim.vertex0, prim.vertex1, prim.vertex2, prim.vertex3})
+                    >= vertexCount)
+                    continue;
+                // PS1 quads are drawn as 0-1-2 and 1-3-2, so going around them is 0-1-3-2.
+                obj << "f " << vertexOffset + prim.vertex0 << ' ' << vertexOffset + prim.vertex1
+                    << ' ' << vertexOffset + prim.vertex3 << ' ' << vertexOffset + prim.vertex2
+                    << '\n';
+            }
+            else
+                continue;
+            faceCount++;
+        }
+
+        vertexOffset += vertexCount;
+    }
+    return faceCount;
+}
+
+void Model::fixShiftedIndices(Mesh& mesh)
 {
     //Quick Hack:
     //  Loop through each primitive and convert the vertex offsets to indices
     //
-    for (Model::Mesh& mesh : Model::baseObjects)
+    for (Model::Primitive& prim : mesh.primitives)
     {
-        for (Model::Primitive& prim : mesh.primitives)
-        {
-            prim.vertex0 = prim.vertex0 >> 3;
-            prim.vertex1 = prim.vertex1 >> 3;
-            prim.vertex2 = prim.vertex2 >> 3;
-            if (prim.isQuad()) prim.vertex3 = prim.vertex3 >> 3;
+        prim.vertex0 = prim.vertex0 >> 3;
+        prim.vertex1 = prim.vertex1 >> 3;
+        prim.vertex2 = prim.vertex2 >> 3;
+        if (prim.isQuad()) prim.vertex3 = prim.vertex3 >> 3;
 
-            prim.normal0 = prim.normal0 >> 3;
+        prim.normal0 = prim.normal0 >> 3;
 
-            if (prim.isSmooth())
-            {
-                prim.normal1 = prim.normal1 >> 3;
-                prim.normal2 = prim.normal2 >> 3;
-                if (prim.isQuad()) prim.normal3 = prim.normal3 >> 3;
-            }
+        if (prim.isSmooth())
+        {
+            prim.normal1 = prim.normal1 >> 3;
+            prim.normal2 = prim.normal2 >> 3;
+            if (prim.isQuad()) prim.normal3 = prim.normal3 >> 3;
         }
     }
 }
 
 void Model::loadMIM(const QByteArray& file)
 {
-    QDataStream mimStream(file);
-    mimStream.setByteOrder(QDataStream::LittleEndian);
+    BinaryReader mimStream(file);
 
     const auto header = readMIMOrMOHeader(mimStream);
-    const auto tmdSection = file.mid(header.tmdOffset);
 
-    if (!Utilities::fileIsTMD(tmdSection))
+    if (header.tmdOffset >= static_cast<uint32_t>(file.size())
+        || !Utilities::fileIsTMD(QByteArray::fromRawData(file.constData() + header.tmdOffset,
+                                                          file.size()
+                                                              - static_cast<int>(header.tmdOffset))))
     {
         KFMTError::error("Model::loadMIM: Did not find a TMD at the expected location!");
         return;
     }
 
-    loadTMD(tmdSection);
+    loadTMD(file, header.tmdOffset);
 
     return;
 
@@ -67,7 +123,7 @@ void Model::loadMIM(const QByteArray& file)
     if (header.animationCount == 0) return;
 
     // Read the morph target table offsets
-    mimStream.device()->seek(header.morphTargetsOffset);
+    mimStream.seek(header.morphTargetsOffset);
 
     quint32 morphTargetTableEnd;
     // Create vector for the morph target offsets
@@ -89,17 +145,11 @@ void Model::loadMIM(const QByteArray& file)
     // Read the morph targets
     for (const auto& morphTargetOffset : morphTargetOffsets)
     {
-        // To define the reference mesh, check if animFrames is empty
-        // If animFrames is empty, use the base TMD as a reference
-        // otherwise, use the last frame's final morph target
-        Mesh targetMesh = animFrames.empty() ? baseObjects.front()
-                                             : morphTargets.at(animFrames.back().targets.back());
-
         // Seek to the morph target's offset
-        mimStream.device()->seek(morphTargetOffset);
+        mimStream.seek(morphTargetOffset);
 
         // Skip the two unknown uints at the beginning of a MIM morph target
-        mimStream.skipRawData(8u);
+        mimStream.skip(8u);
 
         uint32_t vertexAmount;
         mimStream >> vertexAmount;
@@ -110,14 +160,13 @@ void Model::loadMIM(const QByteArray& file)
             if (morph.x == 0 && morph.y == 0 && morph.z == 0) continue;
         }
 
-        morphTargets.push_back(targetMesh);
+        morphTargets.emplace_back();
     }
 }
 
 void Model::loadMO(const QByteArray& file)
 {
-    QDataStream moStream(file);
-    moStream.setByteOrder(QDataStream::LittleEndian);
+    BinaryReader moStream(file);
 
     quint32 tempUInt;
     quint32 animationAmount_;
@@ -126,16 +175,20 @@ void Model::loadMO(const QByteArray& file)
     quint32 animationTableOffset;
 
     // Read header
-    moStream.setByteOrder(QDataStream::LittleEndian);
     moStream >> tempUInt;         // Skip file length
     moStream >> animationAmount_; // Get number of animations
-    animations.reserve(animationAmount_);
     moStream >> tmdOffset;
     moStream >> morphTargetTableOffset;
     moStream >> animationTableOffset;
 
     // Here we do things a bit backwards: We'll read the TMD first
-    auto tmdSection = file.mid(tmdOffset);
+    if (tmdOffset >= static_cast<uint32_t>(file.size()))
+    {
+        KFMTError::error("Model::loadMO: Did not find a TMD at the expected location!");
+        return;
+    }
+    const auto tmdSection = QByteArray::fromRawData(file.constData() + tmdOffset,
+                                                    file.size() - static_cast<int>(tmdOffset));
 
     if (!Utilities::fileIsTMD(tmdSection))
     {
@@ -143,151 +196,403 @@ void Model::loadMO(const QByteArray& file)
         return;
     }
 
-    loadTMD(tmdSection);
+    loadTMD(file, tmdOffset);
 
     // If there are no animations, we pack up and go. This MO serves as just a TMD encapsulator.
-    if (animationAmount_ == 0 || Utilities::fileIsSTTMD(tmdSection)) return;
+    if (animationAmount_ == 0 || baseObjects.empty() || Utilities::fileIsSTTMD(tmdSection))
+        return;
+
+    // Every morph target is applied to the base object, so it's decoded right away. Decoding
+    // animations, which can happen in the background, then never has to.
+    object(0);
 
     // Read the morph target table offsets
-    moStream.device()->seek(morphTargetTableOffset);
+    moStream.seek(morphTargetTableOffset);
 
     quint32 morphTargetTableEnd;
-    // Create vector for the morph target offsets
-    std::vector<quint32> morphTargetOffsets;
 
     // The first morph target offset also serves as the end of the morph target table
     moStream >> morphTargetTableEnd;
-    morphTargetOffsets.push_back(morphTargetTableEnd);
+    m_morphTargetOffsets.push_back(morphTargetTableEnd);
+
+    if (morphTargetTableEnd < morphTargetTableOffset + 4 || morphTargetTableEnd > moStream.size())
+    {
+        KFMTError::error("Model::loadMO: The morph target table ends outside of the file.");
+        return;
+    }
 
     quint32 morphTargetTableSize = (morphTargetTableEnd - morphTargetTableOffset) / 4;
 
     for (size_t i = 0; i < morphTargetTableSize - 1; i++)
     {
         moStream >> tempUInt;
-        morphTargetOffsets.push_back(tempUInt);
+        m_morphTargetOffsets.push_back(tempUInt);
     }
 
-    // Read the morph targets
-    for (const auto& morphTargetOffset : morphTargetOffsets)
+    // Read the animation table. The animations and the morph targets they use are only decoded
+    // once they're asked for, see decodeAnimation.
+    moStream.seek(animationTableOffset);
+    if (animationAmount_ > moStream.remaining() / 4)
     {
-        Mesh& referenceMesh =
-            // To define the reference mesh, check if animFrames is empty
-            animFrames.empty() ?
-                               // If animFrames is empty, use the base TMD as a reference
-                baseObjects.front()
-                               :
-                               // otherwise, use the last frame's final morph target
-                morphTargets.at(animFrames.back().targets.back());
+        KFMTError::error("Model::loadMO: The animation table ends outside of the file.");
+        return;
+    }
 
-        std::vector<quint32> packetOffsets;
-        std::vector<MOPacket> packets;
+    animations.resize(animationAmount_);
+    for (auto& animation : animations) moStream >> animation.offset;
 
-        // Seek to the morph target's offset
-        moStream.device()->seek(morphTargetOffset);
+    morphTargets.resize(m_morphTargetOffsets.size());
+    m_pendingMorphTargets.assign(morphTargets.size(), true);
+    m_pendingAnimations.assign(animations.size(), true);
+    m_prefetchPool.setMaxThreadCount(1);
+
+    if (!moStream.ok())
+        KFMTError::error(QStringLiteral("Model::loadMO: %1").arg(moStream.errorString()));
+}
+
+void Model::decodeAnimation(size_t index)
+{
+    m_pendingAnimations[index] = false;
+    auto& animation = animations[index];
+    BinaryReader moStream(m_fileData);
+
+    moStream.seek(animation.offset);
+    quint32 frameAmount;
+    moStream >> frameAmount;
+    if (frameAmount > moStream.remaining() / 4)
+    {
+        KFMTError::error(QStringLiteral("Model: MO animation %1 has more frames than fit in the "
+                                        "file.")
+                             .arg(index));
+        return;
+    }
+
+    std::vector<quint32> frameOffsets(frameAmount);
+    for (quint32& frameOffset : frameOffsets) moStream >> frameOffset;
+    animation.frames.reserve(frameAmount);
+
+    // Read the frames, and the morph targets they blend
+    for (const quint32& frameOffset : frameOffsets)
+    {
+        moStream.seek(frameOffset);
+        short unknown00;
+        short weight;
+        short frameID;
+        short targetAmount;
+
+        moStream >> unknown00;
+        moStream >> weight;
+        moStream >> frameID;
+        moStream >> targetAmount;
+        if (targetAmount < 0 || !moStream.ok()) break;
+
+        MOFrame newFrame(unknown00, weight, frameID, targetAmount);
+        for (uint16_t& targetIndex : newFrame.targets) moStream >> targetIndex;
+
+        if (static_cast<size_t>(frameID) < morphTargets.size()) decodeMorphTarget(frameID);
+        for (const auto targetIndex : newFrame.targets)
+            if (targetIndex < morphTargets.size()) decodeMorphTarget(targetIndex);
+
+        animation.frames.push_back(std::move(newFrame));
+    }
+
+    if (!moStream.ok())
+        KFMTError::error(QStringLiteral("Model: MO animation %1: %2")
+                             .arg(index)
+                             .arg(moStream.errorString()));
+}
+
+void Model::decodeMorphTarget(size_t index)
+{
+    if (!m_pendingMorphTargets[index]) return;
+    m_pendingMorphTargets[index] = false;
+
+    // Only the vertices a target moves are kept, everything else is the base object's.
+    const auto baseVertexCount = baseObjects[0].vertices.size();
+    auto& target = morphTargets[index];
+    BinaryReader moStream(m_fileData);
+    moStream.seek(m_morphTargetOffsets[index]);
 
-        // Read the amount of packets and preallocates the minimum amount of packets in the morph target
-        quint16 packetAmount;
-        moStream >> packetAmount;
+    quint16 packetAmount;
+    moStream >> packetAmount;
 
-        // Read the packets
-        for (size_t curPacket = 0; curPacket < packetAmount; curPacket++)
+    // Read the packets. Dummy packets skip vertices, and empty packets leave one unchanged.
+    size_t vertex = 0;
+    for (size_t curPacket = 0; curPacket < packetAmount && moStream.ok(); curPacket++)
+    {
+        short idOrX;  // PacketID for type 1, X delta for type 2
+        short numOrY; // Number of dummy packets it represents for type 1, Y delta for type 2
+        moStream >> idOrX;
+        moStream >> numOrY;
+        if (idOrX == static_cast<short>(0x8000))
         {
-            short idOrX;  // PacketID for type 1, X delta for type 2
-            short numOrY; // Number of dummy packets it represents for type 1, Y delta for type 2
-            moStream >> idOrX;
-            moStream >> numOrY;
-            if (idOrX == static_cast<short>(0x8000))
-                for (short curDummyPacket = 0; curDummyPacket < numOrY; curDummyPacket++)
-                    packets.emplace_back();
-            else
+            if (numOrY > 0) vertex += static_cast<size_t>(numOrY);
+        }
+        else
+        {
+            short zDiff;
+            moStream >> zDiff;
+            if (vertex < baseVertexCount && (idOrX != 0 || numOrY != 0 || zDiff != 0))
             {
-                short zDiff;
-                moStream >> zDiff;
-                packets.emplace_back(idOrX, numOrY, zDiff);
+                target.indices.push_back(static_cast<uint32_t>(vertex));
+                target.positions.emplace_back(idOrX, numOrY, zDiff);
             }
+            vertex++;
         }
+    }
 
-        // Initialize this target's mesh with our reference mesh
-        Mesh targetMesh = referenceMesh;
+    target.indices.shrink_to_fit();
+    target.positions.shrink_to_fit();
 
-        auto packetIt = packets.cbegin();
-        auto vertexIt = targetMesh.vertices.begin();
+    if (!moStream.ok())
+        KFMTError::error(QStringLiteral("Model: MO morph target %1: %2")
+                             .arg(index)
+                             .arg(moStream.errorString()));
+}
 
-        while (packetIt != packets.cend() && vertexIt != targetMesh.vertices.end())
-        {
-            vertexIt->applyPacket(*packetIt);
-            packetIt++;
-            vertexIt++;
-        };
+const Model::MOAnimation& Model::animation(size_t index)
+{
+    {
+        std::lock_guard lock(m_moMutex);
+        if (!m_pendingAnimations[index]) return animations[index];
+        decodeAnimation(index);
+    }
+
+    prefetchAnimation(index + 1);
+    return animations[index];
+}
+
+void Model::prefetchAnimation(size_t index)
+{
+    // The animation count never changes after loading, so this doesn't need the lock.
+    if (index >= animations.size()) return;
+
+    m_prefetchPool.start([this, index]() {
+        std::lock_guard lock(m_moMutex);
+        if (m_pendingAnimations[index]) decodeAnimation(index);
+    });
+}
+
+void Model::decodeAllAnimations()
+{
+    std::lock_guard lock(m_moMutex);
+    for (size_t i = 0; i < animations.size(); i++)
+        if (m_pendingAnimations[i]) decodeAnimation(i);
+    for (size_t i = 0; i < morphTargets.size(); i++)
+        decodeMorphTarget(i);
+}
+
+void Model::loadRTMD(const QByteArray &file)
+{
+    // This just calls the TMD loading function and then makes all objects except for the 
+    // first one invisible. RTMD primitives index vertices by byte offset, which decodeObject
+    // turns into indices.
+    m_shiftedIndices = true;
+    loadTMD(file);
+    for (size_t i = 1; i < baseObjects.size(); i++)
+        baseObjects[i].visible = false;
+}
+
+void Model::loadTMD(const QByteArray& file, uint32_t offset)
+{
+    if (offset >= static_cast<uint32_t>(file.size()))
+    {
+        KFMTError::error("Model: The TMD starts past the end of the file. Bailing out.");
+        return;
+    }
+
+    // A view of the TMD inside the file, not a copy.
+    const auto tmd = offset == 0 ? file
+                                 : QByteArray::fromRawData(file.constData() + offset,
+                                                           file.size() - static_cast<int>(offset));
 
-        morphTargets.push_back(targetMesh);
+    // Shadow Tower has a customized TMD that does some funky stuff to eliminate the 4 byte
+    // overhead of the primitive header, so it can't be read through PS1::TMD.
+    if (Utilities::fileIsSTTMD(tmd))
+    {
+        loadSTTMD(tmd);
+        return;
     }
 
-    // Read the animation table
+    if (!PS1::TMD::isValid(file, offset))
+    {
+        KFMTError::error("Model: The TMD object table is cut off. Bailing out.");
+        return;
+    }
 
-    moStream.device()->seek(animationTableOffset);
-    std::vector<quint32> animationOffsets;
-    animationOffsets.resize(animationAmount_);
+    const auto id = Utilities::as<uint32_t>(file, offset);
+    if (id != 0x41 && id != 00)
+    {
+        KFMTError::error("Model: (R)TMD ID is not 0x41 or 0x00. Bailing out.");
+        return;
+    }
 
-    for (quint32& animOffset : animationOffsets) moStream >> animOffset;
+    const auto flags = Utilities::as<uint32_t>(file, offset + 4);
+    if (flags != 0 && flags != 0x12 && flags != 0x10)
+    {
+        KFMTError::error("TMD addresses are not relative. Bailing out.");
+        return;
+    }
+
+    // Objects are only decoded once they're asked for, see decodeObject.
+    m_tmd.emplace(file, offset);
+    const auto nobj = m_tmd->objectCount();
+    baseObjects.resize(nobj);
+    m_pendingObjects.assign(nobj, true);
+    if (nobj != 0) scale = static_cast<float>(m_tmd->object(nobj - 1).scale) / 4096.f;
+}
 
-    auto curAnimNo = 0; // Used for printing the animation line
-    // Read the animations
-    for (const quint32& animOffset : animationOffsets)
+void Model::decodeObject(size_t index)
+{
+    m_pendingObjects[index] = false;
+    const auto tmdObject = m_tmd->object(static_cast<uint32_t>(index));
+    auto& obj = baseObjects[index];
+
+    if (tmdObject.vertices == nullptr || tmdObject.normals == nullptr)
     {
-        moStream.device()->seek(animOffset);
-        quint32 frameAmount;
-        std::vector<quint32> frameOffsets;
-        MOAnimation newAnimation;
+        KFMTError::error(QStringLiteral("Model: TMD object %1's vertices or normals go past the "
+                                        "end of the file.")
+                             .arg(index));
+        return;
+    }
 
-        moStream >> frameAmount;
-        frameOffsets.resize(frameAmount);
+    obj.vertices.assign(tmdObject.vertices, tmdObject.vertexCount);
+    obj.normals.assign(tmdObject.normals, tmdObject.normalCount);
 
-        newAnimation.frameIndexes.reserve(frameAmount);
+    // Every primitive takes at least 4 bytes, so bigger counts can only come from a broken file.
+    if (tmdObject.primitives == nullptr || tmdObject.primitiveCount > tmdObject.primitiveBytes / 4)
+    {
+        KFMTError::error(QStringLiteral("Model: TMD object %1 has more primitives than fit in the "
+                                        "file.")
+                             .arg(index));
+        return;
+    }
 
-        for (quint32& frameOffset : frameOffsets) moStream >> frameOffset;
+    BinaryReader primStream(static_cast<const uint8_t*>(tmdObject.primitives),
+                            tmdObject.primitiveBytes);
+    obj.primitives.resize(tmdObject.primitiveCount);
+    for (auto& primitive : obj.primitives)
+    {
+        if (!primStream.ok()) break;
+        primitive.readFrom(primStream);
+    }
 
-        // Read the frames
-        for (const quint32& frameOffset : frameOffsets)
-        {
-            moStream.device()->seek(frameOffset);
-            short unknown00;
-            short weight;
-            short frameID;
-            short targetAmount;
-
-            moStream >> unknown00;
-            moStream >> weight;
-            moStream >> frameID;
-            moStream >> targetAmount;
-
-            MOFrame newFrame(unknown00, weight, frameID, targetAmount);
-            for (uint16_t& targetIndex : newFrame.targets) moStream >> targetIndex;
-
-            animFrames.push_back(newFrame);
-            newAnimation.frameIndexes.push_back(animFrames.size() - 1);
-        }
+    if (!primStream.ok())
+        KFMTError::error(QStringLiteral("Model: TMD object %1: %2")
+                             .arg(index)
+                             .arg(primStream.errorString()));
+
+    if (m_shiftedIndices) fixShiftedIndices(obj);
+}
+
+void Model::decodeAllObjects()
+{
+    for (size_t i = 0; i < baseObjects.size(); i++)
+        object(i);
+}
 
-        animations.push_back(newAnimation);
-        curAnimNo++;
+const Model::TriangleList& Model::triangles(size_t index)
+{
+    if (m_triangleLists.size() != baseObjects.size()) m_triangleLists.resize(baseObjects.size());
+
+    auto& triangleList = m_triangleLists[index];
+    if (!triangleList)
+    {
+        triangleList = std::make_unique<TriangleList>(triangulate(object(index)));
+        // Lines and sprites are part of plenty of models, so this isn't worth bothering anyone
+        // with, let alone once per object.
+        if (triangleList->skippedPrimitives != 0)
+            KFMTError::log(QStringLiteral("Model::triangles: Object %1 has %2 primitives that can't "
+                                          "be drawn (lines, sprites or broken indices).")
+                               .arg(index)
+                               .arg(triangleList->skippedPrimitives));
     }
+    return *triangleList;
 }
 
-void Model::loadRTMD(const QByteArray &file)
+Model::TriangleList Model::triangulate(const Mesh& mesh)
 {
-    // This just calls the TMD loading function and then makes all objects except for the 
-    // first one invisible.
-    loadTMD(file);
-    for (auto objIt = baseObjects.begin() + 1; objIt != baseObjects.end(); objIt++)
-        objIt->visible = false;
+    const auto vertexCount = mesh.vertices.size();
+    const auto normalCount = mesh.normals.size();
+    const auto fits = [vertexCount, normalCount](const Primitive& prim) {
+        const auto quad = prim.isQuad();
+        if (std::max({prim.vertex0, prim.vertex1, prim.vertex2, quad ? prim.vertex3 : uint16_t {0}})
+                >= vertexCount
+            || prim.normal0 >= normalCount)
+            return false;
+        return !prim.isSmooth()
+               || std::max({prim.normal1, prim.normal2, quad ? prim.normal3 : uint16_t {0}})
+                      < normalCount;
+    };
+
+    // Count the corners first, so everything is written straight into place.
+    TriangleList list;
+    size_t cornerCount = 0;
+    for (const auto& prim : mesh.primitives)
+    {
+        if ((!prim.isTriangle() && !prim.isQuad()) || !fits(prim))
+        {
+            list.skippedPrimitives++;
+            continue;
+        }
+        const size_t corners = prim.isQuad() ? 6 : 3;
+        cornerCount += prim.isDoubleSided() ? corners * 2 : corners;
+    }
+    list.vertices.resize(cornerCount);
+    list.sourceVertices.resize(cornerCount);
+
+    auto* vertexOut = list.vertices.data();
+    auto* sourceOut = list.sourceVertices.data();
+    for (const auto& prim : mesh.primitives)
+    {
+        if ((!prim.isTriangle() && !prim.isQuad()) || !fits(prim)) continue;
+
+        const auto adaptedCoords = prim.getAdaptedTexCoords();
+        const std::array<uint16_t, 4> vertexIndices {prim.vertex0, prim.vertex1, prim.vertex2,
+                                                     prim.vertex3};
+        const std::array<uint16_t, 4> normalIndices {prim.normal0, prim.normal1, prim.normal2,
+                                                     prim.normal3};
+        const std::array<QVector4D, 4> colours {prim.Colour0(), prim.Colour1(), prim.Colour2(),
+                                                prim.Colour3()};
+
+        std::array<TriangleList::Vertex, 4> corners;
+        for (size_t corner = 0; corner < (prim.isQuad() ? 4u : 3u); corner++)
+        {
+            auto& vertex = corners[corner];
+            vertex.position = mesh.vertices[vertexIndices[corner]];
+            vertex.normal = mesh.normals[prim.isSmooth() ? normalIndices[corner] : prim.normal0];
+            vertex.colour = prim.isGradation() ? colours[corner] : colours[0];
+            vertex.texcoord = adaptedCoords[corner];
+        }
+
+        const auto emit = [&](std::initializer_list<size_t> order) {
+            for (const auto corner : order)
+            {
+                *vertexOut++ = corners[corner];
+                *sourceOut++ = vertexIndices[corner];
+            }
+        };
 
-    fixShiftedIndices();
+        // The PS1 draws quads as 0-1-2 and 1-3-2, with the opposite winding from GL. Double sided
+        // primitives are just drawn again, wound the other way.
+        if (prim.isTriangle())
+        {
+            emit({2, 1, 0});
+            if (prim.isDoubleSided()) emit({0, 2, 1});
+        }
+        else
+        {
+            emit({2, 1, 0, 2, 3, 1});
+            if (prim.isDoubleSided()) emit({0, 2, 1, 1, 2, 3});
+        }
+    }
+
+    return list;
 }
 
-void Model::loadTMD(const QByteArray& file)
+void Model::loadSTTMD(const QByteArray& file)
 {
-    QDataStream tmdStream(file);
-    tmdStream.setByteOrder(QDataStream::LittleEndian);
+    BinaryReader tmdStream(file);
 
     // Header section
     uint32_t id;
@@ -303,13 +608,14 @@ void Model::loadTMD(const QByteArray& file)
         KFMTError::error("TMD addresses are not relative. Bailing out.");
 
     tmdStream >> nobj;
+    if (nobj > tmdStream.remaining() / 40)
+    {
+        KFMTError::error("Model: ST TMD object table is cut off. Bailing out.");
+        return;
+    }
     baseObjects.resize(nobj);
 
-    quint64 objTableOffset = tmdStream.device()->pos();
-
-    // We need to check if this is a Shadow Tower TMD file or a traditional TMD file.
-    // You'll find out why soon.
-    bool isShadowTower = Utilities::fileIsSTTMD(file);
+    quint64 objTableOffset = tmdStream.pos();
 
     for (quint32 curObj = 0; curObj < nobj; curObj++)
     {
@@ -317,25 +623,29 @@ void Model::loadTMD(const QByteArray& file)
         quint32 vertexCount;
         quint32 normalsOffset;
         quint32 normalCount;
-        quint32 primitivesOffset;
         quint32 primitiveCount;
-        qint32 tempScale;
 
         tmdStream >> verticesOffset;
         tmdStream >> vertexCount;
         tmdStream >> normalsOffset;
         tmdStream >> normalCount;
-        tmdStream >> primitivesOffset;
+        tmdStream.skip(4); // Primitives offset, unused since they come after the counts below
         tmdStream >> primitiveCount;
-        if (!isShadowTower)
-        {
-            tmdStream >> tempScale;
-            scale = static_cast<float>(tempScale) / 4096.f;
-        }
 
         verticesOffset += objTableOffset;
         normalsOffset += objTableOffset;
-        primitivesOffset += objTableOffset;
+
+        // Every vertex and normal takes 8 bytes, and every primitive at least 4, so bigger counts
+        // can only come from a broken file. Don't let them allocate gigabytes.
+        const size_t fileSize = tmdStream.size();
+        if (vertexCount > fileSize / 8 || normalCount > fileSize / 8 || primitiveCount > fileSize / 4)
+        {
+            KFMTError::error(QStringLiteral("Model: TMD object %1 has more vertices, normals or "
+                                            "primitives than fit in the file. Bailing out.")
+                                 .arg(curObj));
+            baseObjects.resize(curObj);
+            return;
+        }
 
         auto& obj = baseObjects[curObj];
 
@@ -356,7 +666,6 @@ void Model::loadTMD(const QByteArray& file)
         uint16_t stPrimx28Count;
         uint16_t stPrimx38Count;
 
-        if (isShadowTower)
         {
             tmdStream >> stPrimx24Count;
             tmdStream >> stPrimx34Count;
@@ -367,6 +676,18 @@ void Model::loadTMD(const QByteArray& file)
             tmdStream >> stPrimx28Count;
             tmdStream >> stPrimx38Count;
 
+            if (static_cast<size_t>(stPrimx24Count) + stPrimx34Count + stPrimx2cCount
+                    + stPrimx3cCount + stPrimx20Count + stPrimx30Count + stPrimx28Count
+                    + stPrimx38Count
+                != primitiveCount)
+            {
+                KFMTError::error(QStringLiteral("Model: ST TMD object %1's primitive counts don't "
+                                                "add up. Bailing out.")
+                                     .arg(curObj));
+                baseObjects.resize(curObj);
+                return;
+            }
+
             size_t curPrim = 0;
 
             for (uint16_t i = 0; i < stPrimx24Count; i++, curPrim++)
@@ -418,38 +739,33 @@ void Model::loadTMD(const QByteArray& file)
                 obj.primitives[curPrim].readx38(tmdStream);
             }
 
-            fixShiftedIndices();
+            fixShiftedIndices(obj);
         }
 
         // Read object vertices
-        tmdStream.device()->seek(verticesOffset);
-        for (auto& vertex : obj.vertices) vertex.readSVECTOR(tmdStream);
+        tmdStream.seek(verticesOffset);
+        if (const auto* vertices = tmdStream.view<PS1::SVECTOR>(vertexCount))
+            obj.vertices.assign(vertices, vertexCount);
 
         // Read object normals
-        tmdStream.device()->seek(normalsOffset);
-        for (auto& normal : obj.normals) normal.readSVECTOR(tmdStream);
-
-        if (!isShadowTower)
-        {
-            // Read object primitives
-            tmdStream.device()->seek(primitivesOffset);
-            for (auto& primitive : obj.primitives) primitive.readFrom(tmdStream);
-        }
+        tmdStream.seek(normalsOffset);
+        if (const auto* normals = tmdStream.view<PS1::SVECTOR>(normalCount))
+            obj.normals.assign(normals, normalCount);
 
         // Seek to the next object's position in the object table
-        // ST TMD object tables are bigger than normal TMDs, so we need a distinction
-        if (isShadowTower)
-            tmdStream.device()->seek(objTableOffset + ((curObj + 1u) * 40u));
-        else
-            tmdStream.device()->seek(objTableOffset + ((curObj + 1u) * 28u));
+        // ST TMD object tables are bigger than normal TMDs, since they have the primitive counts
+        tmdStream.seek(objTableOffset + ((curObj + 1u) * 40u));
     }
+
+    if (!tmdStream.ok())
+        KFMTError::error(QStringLiteral("Model::loadSTTMD: %1").arg(tmdStream.errorString()));
 }
 
-Model::MIMOrMOHeader Model::readMIMOrMOHeader(QDataStream& stream)
+Model::MIMOrMOHeader Model::readMIMOrMOHeader(BinaryReader& stream)
 {
     MIMOrMOHeader header{};
 
-    stream.skipRawData(4u);          // Skip file length
+    stream.skip(4u);          // Skip file length
     stream >> header.animationCount; // Get number of animations
     stream >> header.tmdOffset;
     stream >> header.morphTargetsOffset;
@@ -458,30 +774,74 @@ Model::MIMOrMOHeader Model::readMIMOrMOHeader(QDataStream& stream)
     return header;
 }
 
-void Model::Vec3::applyPacket(const MOPacket& packet)
+void Model::VertexArray::assign(const PS1::SVECTOR* vectors, size_t count)
 {
-    if (packet.x == 0 && packet.y == 0 && packet.z == 0)
-        return;
-    
-    x = static_cast<float>(packet.x) / 4096.f;
-    y = static_cast<float>(packet.y) / 4096.f;
-    z = static_cast<float>(packet.z) / 4096.f;
+    resize(count);
+    constexpr float fixedPointScale = 1.f / 4096.f;
+    size_t i = 0;
+
+#ifdef FSMT_SVECTOR_SSE2
+    // Two SVECTORs fit in a register. Sign-extending each half to 32 bits gives one vector per
+    // register, and transposing four of those gives an x, a y and a z register (and the padding).
+    const auto scale = _mm_set1_ps(fixedPointScale);
+    const auto widen = [](__m128i halves, bool high) {
+        const auto doubled = high ? _mm_unpackhi_epi16(halves, halves)
+                                  : _mm_unpacklo_epi16(halves, halves);
+        return _mm_cvtepi32_ps(_mm_srai_epi32(doubled, 16));
+    };
+    for (; i + 4 <= count; i += 4)
+    {
+        const auto first = _mm_loadu_si128(reinterpret_cast<const __m128i*>(vectors + i));
+        const auto second = _mm_loadu_si128(reinterpret_cast<const __m128i*>(vectors + i + 2));
+        auto xs = widen(first, false);
+        auto ys = widen(first, true);
+        auto zs = widen(second, false);
+        auto pads = widen(second, true);
+        _MM_TRANSPOSE4_PS(xs, ys, zs, pads);
+        _mm_storeu_ps(x.data() + i, _mm_mul_ps(xs, scale));
+        _mm_storeu_ps(y.data() + i, _mm_mul_ps(ys, scale));
+        _mm_storeu_ps(z.data() + i, _mm_mul_ps(zs, scale));
+    }
+#endif
+
+    for (; i < count; i++)
+    {
+        x[i] = static_cast<float>(vectors[i].vx) * fixedPointScale;
+        y[i] = static_cast<float>(vectors[i].vy) * fixedPointScale;
+        z[i] = static_cast<float>(vectors[i].vz) * fixedPointScale;
+    }
 }
 
-void Model::Vec3::readSVECTOR(QDataStream& in)
+std::shared_ptr<const Model::VertexArray> Model::morphTargetVertices(size_t index)
 {
-    short vx;
-    short vy;
-    short vz;
+    std::lock_guard lock(m_moMutex);
+    const auto cached = std::find_if(m_morphTargetCache.begin(), m_morphTargetCache.end(),
+                                     [index](const auto& entry) { return entry.first == index; });
+    if (cached != m_morphTargetCache.end())
+    {
+        std::rotate(m_morphTargetCache.begin(), cached, cached + 1);
+        return m_morphTargetCache.front().second;
+    }
 
-    in >> vx;
-    in >> vy;
-    in >> vz;
-    in.skipRawData(2);
+    auto vertices = std::make_shared<VertexArray>(baseObjects.empty() ? VertexArray {}
+                                                                      : object(0).vertices);
+    if (index < morphTargets.size())
+    {
+        decodeMorphTarget(index);
+        const auto& target = morphTargets[index];
+        for (size_t i = 0; i < target.indices.size(); i++)
+        {
+            const auto vertex = target.indices[i];
+            const auto& position = target.positions[i];
+            vertices->x[vertex] = static_cast<float>(position.x) / 4096.f;
+            vertices->y[vertex] = static_cast<float>(position.y) / 4096.f;
+            vertices->z[vertex] = static_cast<float>(position.z) / 4096.f;
+        }
+    }
 
-    x = static_cast<float>(vx) / 4096.f;
-    y = static_cast<float>(vy) / 4096.f;
-    z = static_cast<float>(vz) / 4096.f;
+    if (m_morphTargetCache.size() == morphTargetCacheSize) m_morphTargetCache.pop_back();
+    m_morphTargetCache.emplace(m_morphTargetCache.begin(), index, vertices);
+    return vertices;
 }
 
 static constexpr std::array<QVector2D, 32> tPageCoords{
@@ -519,19 +879,14 @@ static constexpr std::array<QVector2D, 32> tPageCoords{
     {3840.f, 256.f},     // TPage 31
 };
 
-std::vector<QVector2D> Model::Primitive::getAdaptedTexCoords() const
+std::array<QVector2D, 4> Model::Primitive::getAdaptedTexCoords() const
 {
-    std::vector<QVector2D> adaptedCoords;
-
-    if (isTriangle())
-        adaptedCoords.resize(3);
-    else if (isQuad())
-        adaptedCoords.resize(4);
-    else
+    if (!isTriangle() && !isQuad())
         KFMTError::fatalError(QStringLiteral(
             "Tried to adapt texcoords for primitive which is neither tri nor quad."));
 
-    std::fill(adaptedCoords.begin(), adaptedCoords.end(), tPageCoords[tsb & 0x1fu]);
+    std::array<QVector2D, 4> adaptedCoords;
+    adaptedCoords.fill(tPageCoords[tsb & 0x1fu]);
 
     float fixedU0 = u0;
     float fixedU1 = u1;
@@ -552,7 +907,7 @@ std::vector<QVector2D> Model::Primitive::getAdaptedTexCoords() const
     return adaptedCoords;
 }
 
-void Model::Primitive::readFrom(QDataStream& stream)
+void Model::Primitive::readFrom(BinaryReader& stream)
 {
     uint8_t tempByte;
 
@@ -571,7 +926,7 @@ void Model::Primitive::readFrom(QDataStream& stream)
     {
         KFMTError::error(
             QString::asprintf("Model: TMD: Invalid mode 0x%x (ilen = %d).", tempByte, ilen));
-        stream.skipRawData(ilen * 4);
+        stream.skip(ilen * 4);
         return;
     }
 
@@ -619,17 +974,17 @@ void Model::Primitive::readFrom(QDataStream& stream)
             KFMTError::error(QString::asprintf("Model: TMD: Unsupported mode 0x%x. Please "
                                                "implement!\n",
                                                static_cast<unsigned int>(mode)));
-            stream.skipRawData(ilen * 4);
+            stream.skip(ilen * 4);
             break;
     }
 }
 
-void Model::Primitive::readx20(QDataStream& stream)
+void Model::Primitive::readx20(BinaryReader& stream)
 {
     stream >> r0;
     stream >> g0;
     stream >> b0;
-    stream.skipRawData(1);
+    stream.skip(1);
     readGradation(stream);
     stream >> normal0;
     stream >> vertex0;
@@ -637,7 +992,7 @@ void Model::Primitive::readx20(QDataStream& stream)
     stream >> vertex2;
 }
 
-void Model::Primitive::readx24(QDataStream& stream)
+void Model::Primitive::readx24(BinaryReader& stream)
 {
     stream >> u0;
     stream >> v0;
@@ -647,14 +1002,14 @@ void Model::Primitive::readx24(QDataStream& stream)
     stream >> tsb;
     stream >> u2;
     stream >> v2;
-    stream.skipRawData(2);
+    stream.skip(2);
     stream >> normal0;
     stream >> vertex0;
     stream >> vertex1;
     stream >> vertex2;
 }
 
-void Model::Primitive::readx25(QDataStream& stream)
+void Model::Primitive::readx25(BinaryReader& stream)
 {
     stream >> u0;
     stream >> v0;
@@ -664,34 +1019,34 @@ void Model::Primitive::readx25(QDataStream& stream)
     stream >> tsb;
     stream >> u2;
     stream >> v2;
-    stream.skipRawData(2);
+    stream.skip(2);
     // FIXME: Is this supposed to be here?
     stream >> r0;
     stream >> g0;
     stream >> b0;
-    stream.skipRawData(1);
+    stream.skip(1);
     stream >> vertex0;
     stream >> vertex1;
     stream >> vertex2;
-    stream.skipRawData(2);
+    stream.skip(2);
 }
 
-void Model::Primitive::readx28(QDataStream& stream)
+void Model::Primitive::readx28(BinaryReader& stream)
 {
     stream >> r0;
     stream >> g0;
     stream >> b0;
-    stream.skipRawData(1);
+    stream.skip(1);
     readGradation(stream);
     stream >> normal0;
     stream >> vertex0;
     stream >> vertex1;
     stream >> vertex2;
     stream >> vertex3;
-    stream.skipRawData(2);
+    stream.skip(2);
 }
 
-void Model::Primitive::readx2c(QDataStream& stream)
+void Model::Primitive::readx2c(BinaryReader& stream)
 {
     stream >> u0;
     stream >> v0;
@@ -701,24 +1056,24 @@ void Model::Primitive::readx2c(QDataStream& stream)
     stream >> tsb;
     stream >> u2;
     stream >> v2;
-    stream.skipRawData(2);
+    stream.skip(2);
     stream >> u3;
     stream >> v3;
-    stream.skipRawData(2);
+    stream.skip(2);
     stream >> normal0;
     stream >> vertex0;
     stream >> vertex1;
     stream >> vertex2;
     stream >> vertex3;
-    stream.skipRawData(2);
+    stream.skip(2);
 }
 
-void Model::Primitive::readx30(QDataStream& stream)
+void Model::Primitive::readx30(BinaryReader& stream)
 {
     stream >> r0;
     stream >> g0;
     stream >> b0;
-    stream.skipRawData(1);
+    stream.skip(1);
     readGradation(stream);
     stream >> normal0;
     stream >> vertex0;
@@ -728,7 +1083,7 @@ void Model::Primitive::readx30(QDataStream& stream)
     stream >> vertex2;
 }
 
-void Model::Primitive::readx34(QDataStream& stream)
+void Model::Primitive::readx34(BinaryReader& stream)
 {
     stream >> u0;
     stream >> v0;
@@ -738,7 +1093,7 @@ void Model::Primitive::readx34(QDataStream& stream)
     stream >> tsb;
     stream >> u2;
     stream >> v2;
-    stream.skipRawData(2);
+    stream.skip(2);
     stream >> normal0;
     stream >> vertex0;
     stream >> normal1;
@@ -747,12 +1102,12 @@ void Model::Primitive::readx34(QDataStream& stream)
     stream >> vertex2;
 }
 
-void Model::Primitive::readx38(QDataStream& stream)
+void Model::Primitive::readx38(BinaryReader& stream)
 {
     stream >> r0;
     stream >> g0;
     stream >> b0;
-    stream.skipRawData(1);
+    stream.skip(1);
     readGradation(stream);
     stream >> normal0;
     stream >> vertex0;
@@ -764,7 +1119,7 @@ void Model::Primitive::readx38(QDataStream& stream)
     stream >> vertex3;
 }
 
-void Model::Primitive::readx3c(QDataStream& stream)
+void Model::Primitive::readx3c(BinaryReader& stream)
 {
     stream >> u0;
     stream >> v0;
@@ -774,10 +1129,10 @@ void Model::Primitive::readx3c(QDataStream& stream)
     stream >> tsb;
     stream >> u2;
     stream >> v2;
-    stream.skipRawData(2);
+    stream.skip(2);
     stream >> u3;
     stream >> v3;
-    stream.skipRawData(2);
+    stream.skip(2);
     stream >> normal0;
     stream >> vertex0;
     stream >> normal1;
@@ -1,18 +1,31 @@
 #ifndef MODEL_H
 #define MODEL_H
 
+#include "core/binaryreader.h"
 #include "datahandlers/kfmtdatahandler.h"
-#include <QDataStream>
+#include "formats/ps1/tmd.h"
+#include "types/ps1/libgte.h"
 #include <QOpenGLBuffer>
+#include <QThreadPool>
+#include <QVector2D>
 #include <QVector3D>
 #include <QVector4D>
+#include <array>
+#include <memory>
+#include <mutex>
+#include <optional>
 
 /*!
  * \brief Class to represent a generic 3D model.
  * This class is made to accomodate the three kinds of model King's Field uses: MO, RTMD and TMD.
- * For MO files, each mesh in the animFrames vector represents a different frame of animation. The
- * baseMesh variable is used as the standard mesh storage for RTMD and TMD files and for the base
- * TMD mesh for MO files.
+ * For MO files, each frame of animation blends two morph targets. The baseObjects vector is used as
+ * the standard mesh storage for RTMD and TMD files and for the base TMD mesh for MO files.
+ * Except for Shadow Tower's, TMDs are read through a PS1::TMD view of the file's data, and each base
+ * object is only decoded the first time object() is called for it. Until then, its Mesh in
+ * baseObjects is empty, so anything that looks at geometry has to go through object().
+ * MO morph targets only store the vertices they move, and morphTargetVertices() applies them to the
+ * base object. MO animations and the morph targets they use are decoded on first use too, through
+ * animation().
  */
 class Model : public KFMTDataHandler
 {
@@ -22,7 +35,43 @@ public:
     /*!
      * \brief Structure for a XYZ vertex.
      */
-    struct Vec3;
+    struct Vec3
+    {
+        float x;
+        float y;
+        float z;
+
+        operator QVector3D() const { return {x, y, z}; }
+    };
+
+    /*!
+     * \brief Array of vertices or normals, stored as one float array per axis.
+     * Indexing it gives a Vec3, so it reads like an array of them, while the SVECTOR conversion and
+     * anything that walks one axis work on contiguous floats.
+     */
+    struct VertexArray
+    {
+        std::vector<float> x;
+        std::vector<float> y;
+        std::vector<float> z;
+
+        [[nodiscard]] size_t size() const { return x.size(); }
+        [[nodiscard]] bool empty() const { return x.empty(); }
+        void resize(size_t count)
+        {
+            x.resize(count);
+            y.resize(count);
+            z.resize(count);
+        }
+
+        Vec3 operator[](size_t index) const { return {x[index], y[index], z[index]}; }
+
+        /*!
+         * \brief Replaces the contents with PS1 fixed point vectors, where 4096 is 1.0.
+         * This converts four vectors at a time with SSE2 where it's available.
+         */
+        void assign(const PS1::SVECTOR* vectors, size_t count);
+    };
 
     /*!
      * \brief Structure for a TMD primitive.
@@ -34,15 +83,20 @@ public:
      */
     struct Mesh
     {
-        std::vector<Vec3> vertices;
-        std::vector<Vec3> normals;
+        VertexArray vertices;
+        VertexArray normals;
         std::vector<Primitive> primitives;
 
         bool visible = true;
 
-        Vec3& operator[](size_t vertex) { return vertices[vertex]; }
+        Vec3 operator[](size_t vertex) const { return vertices[vertex]; }
     };
 
+    /*!
+     * \brief Triangles of a Mesh, the way the viewers draw them.
+     */
+    struct TriangleList;
+
     /*!
      * \brief Header for MIM/MO files.
      */
@@ -55,7 +109,7 @@ public:
     };
 
     /*!
-     * \brief Structure for a MO-style animation. Contains an array of frame indexes.
+     * \brief Structure for a MO-style animation. Contains its frames.
      */
     struct MOAnimation;
 
@@ -64,45 +118,145 @@ public:
      */
     struct MOFrame;
 
+    /*!
+     * \brief Structure for a MO morph target, stored as the vertices it moves.
+     */
+    struct MorphTarget;
+
     /*!
      * \brief Structure for a decoded MO morph target packet.
      */
     struct MOPacket;
 
     explicit Model(KFMTFile& modelFile);
+    ~Model() override;
     void saveChanges() override {}
 
+    /*!
+     * \brief Writes the base objects as a Wavefront OBJ file, one OBJ object per base object.
+     * Only the geometry is written, and quads are kept as quads.
+     * \return Number of faces written.
+     */
+    size_t writeOBJ(QIODevice& output);
+
+    /*!
+     * \brief Gets a base object, decoding it first if that hasn't happened yet.
+     */
+    Mesh& object(size_t index)
+    {
+        if (index < m_pendingObjects.size() && m_pendingObjects[index]) decodeObject(index);
+        return baseObjects[index];
+    }
+
+    /*!
+     * \brief Decodes every base object that hasn't been decoded yet.
+     */
+    void decodeAllObjects();
+
+    /*!
+     * \brief Gets the triangles of a base object, triangulating it the first time.
+     * The result is kept for as long as the model, so building the object again (e.g. for another
+     * MO animation) doesn't walk its primitives again. Primitives that can't be drawn are only
+     * logged.
+     */
+    const TriangleList& triangles(size_t index);
+
+    /*!
+     * \brief Turns a mesh's primitives into a list of triangles. Quads are split in two, and double
+     * sided primitives get a second, reverse-wound copy. Lines, sprites and primitives with
+     * out-of-range indices are left out.
+     */
+    static TriangleList triangulate(const Mesh& mesh);
+
     std::vector<Mesh> baseObjects;
     float scale = 1.0f;
 
+    /*!
+     * \brief Gets an MO animation, decoding its frames and the morph targets they use first if that
+     * hasn't happened yet. The animation after it is then decoded in the background, since it's
+     * likely the next one to be looked at.
+     */
+    const MOAnimation& animation(size_t index);
+
+    /*!
+     * \brief Decodes every MO animation and morph target that hasn't been decoded yet.
+     */
+    void decodeAllAnimations();
+
+    /*!
+     * \brief Gets the vertex positions of a morph target, by applying it to the base object's.
+     * The last few are kept around, since the viewer asks for every target twice in a row. Morph
+     * targets have no normals or primitives of their own, they use the base object's.
+     * \return The positions, or the base object's if there's no such target.
+     */
+    std::shared_ptr<const VertexArray> morphTargetVertices(size_t index);
+
+    /*!
+     * \brief MO animations. Only their offsets are read when loading, so anything that looks at
+     * their frames has to go through animation().
+     */
     std::vector<MOAnimation> animations;
-    std::vector<MOFrame> animFrames;
-    std::vector<Mesh> morphTargets;
+    /*!
+     * \brief MO morph targets. They're decoded along with the first animation that uses them.
+     */
+    std::vector<MorphTarget> morphTargets;
 
 private:
-    void fixShiftedIndices();
+    static constexpr size_t morphTargetCacheSize = 8;
+
+    static void fixShiftedIndices(Mesh& mesh);
+    void decodeObject(size_t index);
+    // These are only called with m_moMutex locked.
+    void decodeAnimation(size_t index);
+    void decodeMorphTarget(size_t index);
+    void prefetchAnimation(size_t index);
     void loadMIM(const QByteArray& file);
     void loadMO(const QByteArray& file);
     void loadRTMD(const QByteArray& file);
-    void loadTMD(const QByteArray& file);
-    Model::MIMOrMOHeader readMIMOrMOHeader(QDataStream& stream);
-};
+    void loadSTTMD(const QByteArray& file);
+    void loadTMD(const QByteArray& file, uint32_t offset = 0);
+    Model::MIMOrMOHeader readMIMOrMOHeader(BinaryReader& stream);
 
-/*!
- * \brief Operator for reading a primitive from a QDataStream.
- * \param in QDataStream to read from.
- * \param primitive Primitive to read into.
- * \return The QDataStream after reading.
- */
-QDataStream& operator>>(QDataStream& in, Model::Primitive& primitive);
+    /*!
+     * \brief A copy of the file's data, which m_tmd looks at.
+     * The file's own data may be a view of a source mapping, which saving can unmap while the
+     * model is still open.
+     */
+    QByteArray m_fileData;
+    std::optional<PS1::TMD> m_tmd;
+    /*!
+     * \brief Which base objects haven't been decoded from m_tmd yet.
+     */
+    std::vector<bool> m_pendingObjects;
+    /*!
+     * \brief Whether primitive indices are byte offsets (RTMD) and have to be shifted on decoding.
+     */
+    bool m_shiftedIndices = false;
+    /*!
+     * \brief Guards everything MO animations are decoded into, since that can happen in the
+     * background: animations, morphTargets, the pending flags and the morph target cache.
+     */
+    std::mutex m_moMutex;
+    std::vector<bool> m_pendingAnimations;
+    std::vector<bool> m_pendingMorphTargets;
+    std::vector<uint32_t> m_morphTargetOffsets;
+    /*!
+     * \brief Triangulated base objects, see triangles(). Empty until asked for.
+     */
+    std::vector<std::unique_ptr<TriangleList>> m_triangleLists;
+    /*!
+     * \brief Recently materialized morph targets, most recently used first.
+     */
+    std::vector<std::pair<size_t, std::shared_ptr<const VertexArray>>> m_morphTargetCache;
+    /*!
+     * \brief Runs the animation prefetches, one at a time. It's last so that it's destroyed, and so
+     * waits for them, before what they decode into.
+     */
+    QThreadPool m_prefetchPool;
+};
 
 // Struct definitions
 
-struct Model::MOAnimation
-{
-    std::vector<size_t> frameIndexes;
-};
-
 struct Model::MOFrame
 {
     short Unknown00 = 0;
@@ -117,6 +271,12 @@ struct Model::MOFrame
     }
 };
 
+struct Model::MOAnimation
+{
+    uint32_t offset = 0; ///< Offset of the animation's frame table in the file.
+    std::vector<MOFrame> frames;
+};
+
 struct Model::MOPacket
 {
     short x = 0;
@@ -128,6 +288,44 @@ struct Model::MOPacket
     MOPacket(const MOPacket& other) : x(other.x), y(other.y), z(other.z) {}
 };
 
+struct Model::MorphTarget
+{
+    /*!
+     * \brief The vertices that move, in increasing order, and where they move to.
+     * Every other vertex stays where it is in the base object.
+     */
+    std::vector<uint32_t> indices;
+    std::vector<MOPacket> positions;
+};
+
+struct Model::TriangleList
+{
+    /*!
+     * \brief Corner of a triangle. This is what gets uploaded to GL, so its layout is fixed.
+     */
+    struct Vertex
+    {
+        QVector3D position;
+        QVector3D normal;
+        QVector4D colour;
+        QVector2D texcoord;
+    };
+    static_assert(sizeof(Vertex) == 48, "Vertex has to be tightly packed for GL");
+
+    /*!
+     * \brief Every corner of every triangle, in drawing order.
+     */
+    std::vector<Vertex> vertices;
+    /*!
+     * \brief Index of each corner's position in the mesh's vertices, so morph targets can replace it.
+     */
+    std::vector<uint16_t> sourceVertices;
+    /*!
+     * \brief Number of primitives that couldn't be triangulated.
+     */
+    size_t skippedPrimitives = 0;
+};
+
 struct Model::Primitive
 {
     /*!
@@ -174,7 +372,10 @@ struct Model::Primitive
     QVector4D Colour2() const { return {r2 / 255.f, g2 / 255.f, b2 / 255.f, alpha / 255.f}; }
     QVector4D Colour3() const { return {r3 / 255.f, g3 / 255.f, b3 / 255.f, alpha / 255.f}; }
 
-    std::vector<QVector2D> getAdaptedTexCoords() const;
+    /*!
+     * \brief Gets the texture coordinates in PS1 VRAM, scaled to 0-1. Triangles only use 3.
+     */
+    std::array<QVector2D, 4> getAdaptedTexCoords() const;
 
     /*!
      * \brief Checks if a primitive is double sided.
@@ -244,51 +445,39 @@ struct Model::Primitive
         return (mode_ >> 5) && !((mode_ >> 3) & 1);
     }
 
-    void readFrom(QDataStream& stream);
+    void readFrom(BinaryReader& stream);
     // Helper method for reading gradation
-    void readGradation(QDataStream& stream)
+    void readGradation(BinaryReader& stream)
     {
         if (isGradation())
         {
             stream >> r1;
             stream >> g1;
             stream >> b1;
-            stream.skipRawData(1);
+            stream.skip(1);
             stream >> r2;
             stream >> g2;
             stream >> b2;
-            stream.skipRawData(1);
+            stream.skip(1);
             if (isQuad())
             {
                 stream >> r3;
                 stream >> g3;
                 stream >> b3;
-                stream.skipRawData(1);
+                stream.skip(1);
             }
         }
     }
     // Primitive packet readers
-    void readx20(QDataStream& stream);
-    void readx24(QDataStream& stream);
-    void readx25(QDataStream& stream);
-    void readx28(QDataStream& stream);
-    void readx2c(QDataStream& stream);
-    void readx30(QDataStream& stream);
-    void readx34(QDataStream& stream);
-    void readx38(QDataStream& stream);
-    void readx3c(QDataStream& stream);
-};
-
-struct Model::Vec3
-{
-    float x;
-    float y;
-    float z;
-
-    void applyPacket(const MOPacket& packet);
-    void readSVECTOR(QDataStream& in);
-
-    operator QVector3D() const { return {x, y, z}; }
+    void readx20(BinaryReader& stream);
+    void readx24(BinaryReader& stream);
+    void readx25(BinaryReader& stream);
+    void readx28(BinaryReader& stream);
+    void readx2c(BinaryReader& stream);
+    void readx30(BinaryReader& stream);
+    void readx34(BinaryReader& stream);
+    void readx38(BinaryReader& stream);
+    void readx3c(BinaryReader& stream);
 };
 
 // Enum definitions
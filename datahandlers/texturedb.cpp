@@ -105,6 +105,17 @@ void TextureDB::replaceTexture(QImage& newTexture, size_t textureIndex, Qt::Tran
     }
 }
 
+size_t TextureDB::exportAll(const QDir& outDir)
+{
+    size_t saved = 0;
+    for (size_t i = 0; i < textures.size(); i++)
+    {
+        if (textures[i].image.save(outDir.filePath(QStringLiteral("Texture%1.png").arg(i)), "png"))
+            saved++;
+    }
+    return saved;
+}
+
 void TextureDB::saveChanges()
 {
     if (type == TexDBType::RTIM) // RTIM File
@@ -117,8 +128,7 @@ void TextureDB::saveChanges()
 
 void TextureDB::loadRTIM()
 {
-    QDataStream rtimStream(file.m_data);
-    rtimStream.setByteOrder(QDataStream::LittleEndian);
+    BinaryReader rtimStream(file.m_data);
     
     while (!rtimStream.atEnd())
     {        
@@ -132,12 +142,14 @@ void TextureDB::loadRTIM()
         
         readPixelData(rtimStream, textures.back());
     }
+
+    if (!rtimStream.ok())
+        KFMTError::error(QStringLiteral("TextureDB: RTIM: %1").arg(rtimStream.errorString()));
 }
 
 void TextureDB::loadTIM()
 {
-    QDataStream timStream(file.m_data);
-    timStream.setByteOrder(QDataStream::LittleEndian);
+    BinaryReader timStream(file.m_data);
     
     uint32_t id;
     uint32_t flag;
@@ -163,9 +175,12 @@ void TextureDB::loadTIM()
         readPixelData(timStream, textures.back());
     else
         textures.pop_back();
+
+    if (!timStream.ok())
+        KFMTError::error(QStringLiteral("TextureDB: TIM: %1").arg(timStream.errorString()));
 }
 
-bool TextureDB::readCLUT(QDataStream & stream, Texture & targetTex)
+bool TextureDB::readCLUT(BinaryReader & stream, Texture & targetTex)
 {
     // RTIM does not have the clut size at the beginning of the header.
     if (type != TexDBType::RTIM)
@@ -204,7 +219,7 @@ bool TextureDB::readCLUT(QDataStream & stream, Texture & targetTex)
     
     const auto clutAmount = targetTex.clutWidth * targetTex.clutHeight;
         
-    for (auto curEntry = 0; curEntry < clutAmount; curEntry++)
+    for (auto curEntry = 0; curEntry < clutAmount && stream.ok(); curEntry++)
     {
         uint16_t clutEntry;
         stream >> clutEntry;
@@ -234,7 +249,7 @@ bool TextureDB::readCLUT(QDataStream & stream, Texture & targetTex)
     return true;
 }
 
-void TextureDB::readPixelData(QDataStream & stream, Texture & targetTex)
+void TextureDB::readPixelData(BinaryReader & stream, Texture & targetTex)
 {
     // RTIM does not have the pixel data size at the beginning of the header.
     if (type != TexDBType::RTIM)
@@ -247,7 +262,7 @@ void TextureDB::readPixelData(QDataStream & stream, Texture & targetTex)
     // FIXME: We should check the dupes just like we do for the CLUT.
     // If this is an RTIM, skip the DX/DY and W/X dupes
     if (type == TexDBType::RTIM)
-        stream.skipRawData(8);
+        stream.skip(8);
     
     // Adjust width properly
     if (targetTex.pMode == PixelMode::CLUT4Bit)
@@ -276,7 +291,7 @@ void TextureDB::readPixelData(QDataStream & stream, Texture & targetTex)
     
     int curPixel = 0;
     
-    while (curPixel < targetTex.pxWidth * targetTex.pxHeight)
+    while (curPixel < targetTex.pxWidth * targetTex.pxHeight && stream.ok())
     {
         uint16_t block0;
         stream >> block0;
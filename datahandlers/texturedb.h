@@ -1,6 +1,7 @@
 #ifndef TEXTUREDB_H
 #define TEXTUREDB_H
 
+#include "core/binaryreader.h"
 #include "datahandlers/kfmtdatahandler.h"
 #include <QImage>
 #include <QPainter>
@@ -30,6 +31,12 @@ public:
 
     explicit TextureDB(KFMTFile& file_);
 
+    /*!
+     * \brief Saves every texture as a PNG file (Texture0.png, Texture1.png...) in a directory.
+     * \return Number of textures that were saved.
+     */
+    size_t exportAll(const QDir& outDir);
+
     QPoint getFramebufferCoordinate(size_t textureIndex);
     Texture &getTexture(size_t textureIndex);
     size_t getTextureCount() const { return textures.size(); }
@@ -41,8 +48,8 @@ private:
     void loadRTIM();
     void loadTIM();
     
-    bool readCLUT(QDataStream &stream, Texture &targetTex);
-    void readPixelData(QDataStream &stream, Texture &targetTex);
+    bool readCLUT(BinaryReader &stream, Texture &targetTex);
+    void readPixelData(BinaryReader &stream, Texture &targetTex);
     
     void writeRTIM();
     void writeTIM();
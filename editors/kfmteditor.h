@@ -19,7 +19,10 @@ public:
     void saveChanges()
     {
         if (handler)
+        {
             handler->saveChanges();
+            handler->getFile().dataChanged();
+        }
     }
 
 protected:
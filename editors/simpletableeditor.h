@@ -16,6 +16,10 @@ public:
     {
         ui->setupUi(this);
         ui->tableView->setModel(m_model.get());
+        // The models write straight to the file, so there's no handler to save changes through.
+        connect(m_model.get(), &QAbstractItemModel::dataChanged, this, [&file_]() {
+            file_.dataChanged();
+        });
     }
     ~SimpleTableEditor() {delete ui;}
     
@@ -145,113 +145,19 @@ void MapViewer3D::buildShader()
 void MapViewer3D::buildTileset()
 {
     const auto index = map->getFile().name().toUInt();
-    auto rtmd = Model(*core.files[QStringLiteral(u"CD/COM/RTMD.T/%1").arg(index / 3)]);
+    auto& rtmdFile = *core.files[QStringLiteral(u"CD/COM/RTMD.T/%1").arg(index / 3)];
+    // Every three maps share an RTMD, so setting another of them keeps the triangles worked out.
+    if (!tileModel || &tileModel->getFile() != &rtmdFile)
+        tileModel = std::make_unique<Model>(rtmdFile);
+    auto& rtmd = *tileModel;
 
+    tileset.clear();
     tileset.reserve(rtmd.baseObjects.size());
 
-    for (const auto& obj : rtmd.baseObjects)
+    for (size_t objectNo = 0; objectNo < rtmd.baseObjects.size(); objectNo++)
     {
+        const auto& vertices = rtmd.triangles(objectNo).vertices;
         auto& mesh = tileset.emplace_back();
-        std::vector<TileMesh::Vertex> vertices;
-        vertices.reserve(obj.vertices.size());
-        for (const auto& prim : obj.primitives)
-        {
-            auto adaptedCoords = prim.getAdaptedTexCoords();
-
-            if (prim.isTriangle())
-            {
-                TileMesh::Vertex v0;
-                TileMesh::Vertex v1;
-                TileMesh::Vertex v2;
-
-                //Vertex 1
-                v0.position = obj.vertices[prim.vertex0];
-                v0.normal = obj.normals[prim.normal0];
-                v0.colour = prim.Colour0();
-                v0.texcoord = adaptedCoords[0];
-
-                //Vertex 2
-                v1.position = obj.vertices[prim.vertex1];
-                v1.normal = prim.isSmooth() ? obj.normals[prim.normal1] : obj.normals[prim.normal0];
-                v1.colour = prim.isGradation() ? prim.Colour1() : prim.Colour0();
-                v1.texcoord = adaptedCoords[1];
-
-                //Vertex 2
-                v2.position = obj.vertices[prim.vertex2];
-                v2.normal = prim.isSmooth() ? obj.normals[prim.normal2] : obj.normals[prim.normal0];
-                v2.colour = prim.isGradation() ? prim.Colour2() : prim.Colour0();
-                v2.texcoord = adaptedCoords[2];
-
-                vertices.push_back(v2);
-                vertices.push_back(v1);
-                vertices.push_back(v0);
-
-                if (prim.isDoubleSided()) //Just reverse-wind the previous triangle
-                {
-                    vertices.push_back(v0);
-                    vertices.push_back(v2);
-                    vertices.push_back(v1);
-                }
-            }
-            else if (prim.isQuad())
-            {
-                TileMesh::Vertex v0;
-                TileMesh::Vertex v1;
-                TileMesh::Vertex v2;
-                TileMesh::Vertex v3;
-
-                //Vertex 1
-                v0.position = obj.vertices[prim.vertex0];
-                v0.normal = obj.normals[prim.normal0];
-                v0.colour = prim.Colour0();
-                v0.texcoord = adaptedCoords[0];
-
-                //Vertex 2
-                v1.position = obj.vertices[prim.vertex1];
-                v1.normal = prim.isSmooth() ? obj.normals[prim.normal1] : obj.normals[prim.normal0];
-                v1.colour = prim.isGradation() ? prim.Colour1() : prim.Colour0();
-                v1.texcoord = adaptedCoords[1];
-
-                //Vertex 2
-                v2.position = obj.vertices[prim.vertex2];
-                v2.normal = prim.isSmooth() ? obj.normals[prim.normal2] : obj.normals[prim.normal0];
-                v2.colour = prim.isGradation() ? prim.Colour2() : prim.Colour0();
-                v2.texcoord = adaptedCoords[2];
-
-                //Vertex 2
-                v3.position = obj.vertices[prim.vertex3];
-                v3.normal = prim.isSmooth() ? obj.normals[prim.normal3] : obj.normals[prim.normal0];
-                v3.colour = prim.isGradation() ? prim.Colour3() : prim.Colour0();
-                v3.texcoord = adaptedCoords[3];
-
-                //Split the quad into two seperate triangles
-
-                //Tri 1 (0, 1, 2)
-                vertices.push_back(v2);
-                vertices.push_back(v1);
-                vertices.push_back(v0);
-
-                //Tri 2 (2, 3, 1)
-                vertices.push_back(v2);
-                vertices.push_back(v3);
-                vertices.push_back(v1);
-
-                if (prim.isDoubleSided()) //Just reverse-wind the previous triangle
-                {
-                    //Tri 1 (0, 1, 2)
-                    vertices.push_back(v0);
-                    vertices.push_back(v2);
-                    vertices.push_back(v1);
-
-                    //Tri 2 (1, 3, 2)
-                    vertices.push_back(v1);
-                    vertices.push_back(v2);
-                    vertices.push_back(v3);
-                }
-            }
-            else
-                KFMTError::error("MapViewer3D: Unhandled TMD primitive type (line or sprite).");
-        }
 
         mesh.buffer.create();
         mesh.vao.create();
@@ -2,6 +2,7 @@
 #define MAPVIEWER3D_H
 
 #include "datahandlers/map.h"
+#include "datahandlers/model.h"
 #include <QOpenGLBuffer>
 #include <QOpenGLExtraFunctions>
 #include <QOpenGLShaderProgram>
@@ -49,13 +50,7 @@ private slots:
 private:
     struct TileMesh
     {
-        struct Vertex
-        {
-            QVector3D position;
-            QVector3D normal;
-            QVector4D colour;
-            QVector2D texcoord;
-        };
+        using Vertex = Model::TriangleList::Vertex;
 
         // These empty constructors are here because C++ is hell.
         // Seriously, go ahead and comment them. See the shitstorm that brews up.
@@ -85,6 +80,10 @@ private:
     ShaderParam lightPos;
     QOpenGLTexture psxVRAM{QOpenGLTexture::Target2D};
     std::vector<TileMesh> tileset;
+    /*!
+     * \brief The RTMD the tileset is built from. Kept so its triangles are only worked out once.
+     */
+    std::unique_ptr<Model> tileModel;
 
     QTimer refreshTimer{this};
 
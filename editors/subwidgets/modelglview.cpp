@@ -135,130 +135,8 @@ void ModelGLView::BuildMOAnimation()
     }
     meshes.clear();
 
-    for (const auto& Anim : model->animations)
-    {
-        //Build each animation frame
-        unsigned int i = 0;
-
-        GLMesh& glMesh = meshes.emplace_back();
-        glMesh.frames.resize(Anim.frameIndexes.size());
-
-        //Begin Generating OpenGL stuff for this frame
-        glFuncs->glGenBuffers(Anim.frameIndexes.size(), glMesh.frames.data());
-        glFuncs->glGenVertexArrays(1, &glMesh.VAO);
-
-        //Bind array buffer
-        glFuncs->glBindVertexArray(glMesh.VAO);
-
-        for (const size_t frameID : Anim.frameIndexes)
-        {
-            const Model::Mesh& frame1 = model->morphTargets[model->animFrames[frameID].frameID];
-            const Model::Mesh& frame2
-                = i == Anim.frameIndexes.size() - 1
-                      ? model->morphTargets[model->animFrames[Anim.frameIndexes[0]].frameID]
-                      : model->morphTargets[model->animFrames[frameID + 1].frameID];
-
-            //Now build the actual frame!
-            std::vector<MOVertex> vertices;
-
-            for (const auto& prim : model->baseObjects[0].primitives)
-            {
-                auto adaptedCoords = prim.getAdaptedTexCoords();
-                if (prim.isTriangle())
-                {
-                    MOVertex v0, v1, v2;
-
-                    //Vertex 1
-                    v0.position1 = frame1.vertices[prim.vertex0];
-                    v0.position2 = frame2.vertices[prim.vertex0];
-                    v0.normal = frame1.normals[prim.normal0];
-                    v0.colour = prim.Colour0();
-                    v0.texcoord = adaptedCoords[0];
-
-                    //Vertex 2
-                    v1.position1 = frame1.vertices[prim.vertex1];
-                    v1.position2 = frame2.vertices[prim.vertex1];
-                    v1.normal = prim.isSmooth() ? frame1.normals[prim.normal1]
-                                                : frame1.normals[prim.normal0];
-                    v1.colour = prim.isGradation() ? prim.Colour1() : prim.Colour0();
-                    v1.texcoord = adaptedCoords[1];
-
-                    //Vertex 3
-                    v2.position1 = frame1.vertices[prim.vertex2];
-                    v2.position2 = frame2.vertices[prim.vertex2];
-                    v2.normal = prim.isSmooth() ? frame1.normals[prim.normal2]
-                                                : frame1.normals[prim.normal0];
-                    v2.colour = prim.isGradation() ? prim.Colour2() : prim.Colour0();
-                    v2.texcoord = adaptedCoords[2];
-
-                    vertices.push_back(v2);
-                    vertices.push_back(v1);
-                    vertices.push_back(v0);
-
-                } else if (prim.isQuad())
-                {
-                    MOVertex v0, v1, v2, v3;
-
-                    //Vertex 1
-                    v0.position1 = frame1.vertices[prim.vertex0];
-                    v0.position2 = frame2.vertices[prim.vertex0];
-                    v0.normal = frame1.normals[prim.normal0];
-                    v0.colour = prim.Colour0();
-                    v0.texcoord = adaptedCoords[0];
-
-                    //Vertex 2
-                    v1.position1 = frame1.vertices[prim.vertex1];
-                    v1.position2 = frame2.vertices[prim.vertex1];
-                    v1.normal = prim.isSmooth() ? frame1.normals[prim.normal1]
-                                                : frame1.normals[prim.normal0];
-                    v1.colour = prim.isGradation() ? prim.Colour1() : prim.Colour0();
-                    v1.texcoord = adaptedCoords[1];
-
-                    //Vertex 3
-                    v2.position1 = frame1.vertices[prim.vertex2];
-                    v2.position2 = frame2.vertices[prim.vertex2];
-                    v2.normal = prim.isSmooth() ? frame1.normals[prim.normal2]
-                                                : frame1.normals[prim.normal0];
-                    v2.colour = prim.isGradation() ? prim.Colour2() : prim.Colour0();
-                    v2.texcoord = adaptedCoords[2];
-
-                    //Vertex 4
-                    v3.position1 = frame1.vertices[prim.vertex3];
-                    v3.position2 = frame2.vertices[prim.vertex3];
-                    v3.normal = prim.isSmooth() ? frame1.normals[prim.normal3]
-                                                : frame1.normals[prim.normal0];
-                    v3.colour = prim.isGradation() ? prim.Colour3() : prim.Colour0();
-                    v3.texcoord = adaptedCoords[3];
-
-                    //Tri 1 (2, 1, 0)
-                    vertices.push_back(v2);
-                    vertices.push_back(v1);
-                    vertices.push_back(v0);
-
-                    //Tri 2 (2, 3, 1)
-                    vertices.push_back(v2);
-                    vertices.push_back(v3);
-                    vertices.push_back(v1);
-
-                } else
-                {
-                    KFMTError::error("ModelGLView: Unhandled TMD primitive type (line or sprite).");
-                }
-            }
-            //bind vertex buffer, and copy the data to it
-            glFuncs->glBindBuffer(GL_ARRAY_BUFFER, glMesh.frames[i]);
-            glFuncs->glBufferData(GL_ARRAY_BUFFER,
-                                  vertices.size() * sizeof(MOVertex),
-                                  vertices.data(),
-                                  GL_STATIC_DRAW);
-            //Set vertex number for draw...
-            glMesh.numVertex = vertices.size();
-
-            vertices.clear();
-
-            i++;
-        }
-    }
+    // The animations themselves are only built when they're first drawn, see DrawMOAnimation.
+    meshes.resize(model->animations.size());
 
     //Build MO Shader (only once though)
     if(glMOProgramMVP == 12345678)
@@ -282,6 +160,60 @@ void ModelGLView::BuildMOAnimation()
     animFrameDelta = 0.f;
 }
 
+void ModelGLView::BuildMOAnimationFrames(size_t animationIndex)
+{
+    //Build each animation frame
+    unsigned int i = 0;
+
+    const auto& Anim = model->animation(animationIndex);
+    GLMesh& glMesh = meshes[animationIndex];
+    glMesh.frames.resize(Anim.frames.size());
+
+    //Begin Generating OpenGL stuff for this frame
+    glFuncs->glGenBuffers(Anim.frames.size(), glMesh.frames.data());
+    glFuncs->glGenVertexArrays(1, &glMesh.VAO);
+
+    //Bind array buffer
+    glFuncs->glBindVertexArray(glMesh.VAO);
+
+    // Morph targets only have positions, the rest comes from the base object's triangles
+    const auto& triangles = model->triangles(0);
+    std::vector<MOVertex> vertices(triangles.vertices.size());
+
+    for (const auto& frame : Anim.frames)
+    {
+        const auto frame1Vertices = model->morphTargetVertices(frame.frameID);
+        const auto frame2Vertices = model->morphTargetVertices(
+            i == Anim.frames.size() - 1 ? Anim.frames[0].frameID : Anim.frames[i + 1].frameID);
+        const Model::VertexArray& frame1 = *frame1Vertices;
+        const Model::VertexArray& frame2 = *frame2Vertices;
+
+        //Now build the actual frame!
+        for (size_t corner = 0; corner < vertices.size(); corner++)
+        {
+            const auto& baseVertex = triangles.vertices[corner];
+            const auto sourceVertex = triangles.sourceVertices[corner];
+            auto& vertex = vertices[corner];
+            vertex.position1 = frame1[sourceVertex];
+            vertex.position2 = frame2[sourceVertex];
+            vertex.normal = baseVertex.normal;
+            vertex.colour = baseVertex.colour;
+            vertex.texcoord = baseVertex.texcoord;
+        }
+
+        //bind vertex buffer, and copy the data to it
+        glFuncs->glBindBuffer(GL_ARRAY_BUFFER, glMesh.frames[i]);
+        glFuncs->glBufferData(GL_ARRAY_BUFFER,
+                              vertices.size() * sizeof(MOVertex),
+                              vertices.data(),
+                              GL_STATIC_DRAW);
+        //Set vertex number for draw...
+        glMesh.numVertex = vertices.size();
+
+        i++;
+    }
+}
+
 void ModelGLView::DrawMOAnimation()
 {
     //Set up the shader...
@@ -294,6 +226,9 @@ void ModelGLView::DrawMOAnimation()
     // Bind PSX VRAM texture
     psxVRAM.bind();
 
+    if (meshes[curAnim].VAO == 0) BuildMOAnimationFrames(curAnim);
+    if (meshes[curAnim].frames.empty()) return;
+
     //Draw it...
     glFuncs->glBindVertexArray(meshes[curAnim].VAO);
     glFuncs->glBindBuffer(GL_ARRAY_BUFFER, meshes[curAnim].frames[animFrame]);
@@ -347,111 +282,12 @@ void ModelGLView::BuildTMDModel()
     meshes.clear();
 
     //Build each TMDObject as a GLMesh
-    for (const auto& tmdObj : model->baseObjects)
+    for (size_t objectNo = 0; objectNo < model->baseObjects.size(); objectNo++)
     {
-        std::vector<TMDVertex> vertices;
+        const auto& vertices = model->triangles(objectNo).vertices;
         GLMesh& mesh = meshes.emplace_back();
         mesh.frames.resize(1);
 
-        for (const auto& tmdPrim : tmdObj.primitives)
-        {
-            auto adaptedCoords = tmdPrim.getAdaptedTexCoords();
-            if (tmdPrim.isTriangle())
-            {
-                //Add 3 vertices to the list
-                TMDVertex v0, v1, v2;
-
-                //Vertex 1
-                v0.position = tmdObj.vertices[tmdPrim.vertex0];
-                v0.normal = tmdObj.normals[tmdPrim.normal0];
-                v0.colour = tmdPrim.Colour0();
-                v0.texcoord = adaptedCoords[0];
-
-                //Vertex 2
-                v1.position = tmdObj.vertices[tmdPrim.vertex1];
-                v1.normal = tmdPrim.isSmooth() ? tmdObj.normals[tmdPrim.normal1]
-                                               : tmdObj.normals[tmdPrim.normal0];
-                v1.colour = tmdPrim.isGradation() ? tmdPrim.Colour1() : tmdPrim.Colour0();
-                v1.texcoord = adaptedCoords[1];
-
-                //Vertex 2
-                v2.position = tmdObj.vertices[tmdPrim.vertex2];
-                v2.normal = tmdPrim.isSmooth() ? tmdObj.normals[tmdPrim.normal2]
-                                               : tmdObj.normals[tmdPrim.normal0];
-                v2.colour = tmdPrim.isGradation() ? tmdPrim.Colour2() : tmdPrim.Colour0();
-                v2.texcoord = adaptedCoords[2];
-
-                vertices.push_back(v2);
-                vertices.push_back(v1);
-                vertices.push_back(v0);
-
-                if (tmdPrim.isDoubleSided()) //Just reverse-wind the previous triangle
-                {
-                    vertices.push_back(v0);
-                    vertices.push_back(v2);
-                    vertices.push_back(v1);
-                }
-            }
-            else if (tmdPrim.isQuad())
-            {
-                //Add 4 vertices to the list
-                TMDVertex v0, v1, v2, v3;
-
-                //Vertex 1
-                v0.position = tmdObj.vertices[tmdPrim.vertex0];
-                v0.normal = tmdObj.normals[tmdPrim.normal0];
-                v0.colour = tmdPrim.Colour0();
-                v0.texcoord = adaptedCoords[0];
-
-                //Vertex 2
-                v1.position = tmdObj.vertices[tmdPrim.vertex1];
-                v1.normal = tmdPrim.isSmooth() ? tmdObj.normals[tmdPrim.normal1]
-                                               : tmdObj.normals[tmdPrim.normal0];
-                v1.colour = tmdPrim.isGradation() ? tmdPrim.Colour1() : tmdPrim.Colour0();
-                v1.texcoord = adaptedCoords[1];
-
-                //Vertex 2
-                v2.position = tmdObj.vertices[tmdPrim.vertex2];
-                v2.normal = tmdPrim.isSmooth() ? tmdObj.normals[tmdPrim.normal2]
-                                               : tmdObj.normals[tmdPrim.normal0];
-                v2.colour = tmdPrim.isGradation() ? tmdPrim.Colour2() : tmdPrim.Colour0();
-                v2.texcoord = adaptedCoords[2];
-
-                //Vertex 2
-                v3.position = tmdObj.vertices[tmdPrim.vertex3];
-                v3.normal = tmdPrim.isSmooth() ? tmdObj.normals[tmdPrim.normal3]
-                                               : tmdObj.normals[tmdPrim.normal0];
-                v3.colour = tmdPrim.isGradation() ? tmdPrim.Colour3() : tmdPrim.Colour0();
-                v3.texcoord = adaptedCoords[3];
-
-                //Split the quad into two seperate triangles
-
-                //Tri 1 (0, 1, 2)
-                vertices.push_back(v2);
-                vertices.push_back(v1);
-                vertices.push_back(v0);
-
-                //Tri 2 (2, 3, 1)
-                vertices.push_back(v2);
-                vertices.push_back(v3);
-                vertices.push_back(v1);
-
-                if (tmdPrim.isDoubleSided()) //Just reverse-wind the previous triangle
-                {
-                    //Tri 1 (0, 1, 2)
-                    vertices.push_back(v0);
-                    vertices.push_back(v2);
-                    vertices.push_back(v1);
-
-                    //Tri 2 (1, 3, 2)
-                    vertices.push_back(v1);
-                    vertices.push_back(v2);
-                    vertices.push_back(v3);
-                }
-            } else
-                KFMTError::error("ModelGLView: Unhandled TMD primitive type (line or sprite).");
-        }
-
         //Begin Generating OpenGL stuff for this object
         glFuncs->glGenBuffers(1, mesh.frames.data());
         glFuncs->glGenVertexArrays(1, &mesh.VAO);
@@ -463,7 +299,7 @@ void ModelGLView::BuildTMDModel()
         glFuncs->glBindBuffer(GL_ARRAY_BUFFER, mesh.frames[0]);
         glFuncs->glBufferData(GL_ARRAY_BUFFER,
                               vertices.size() * sizeof(TMDVertex),
-                              &vertices.front(),
+                              vertices.data(),
                               GL_STATIC_DRAW);
 
         //Set up the offsets and strides of each component of the vertex...
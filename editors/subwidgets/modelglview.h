@@ -70,13 +70,7 @@ class ModelGLView : public QOpenGLWidget
 {
     Q_OBJECT
 public:
-    struct TMDVertex
-    {
-        QVector3D position;
-        QVector3D normal;
-        QVector4D colour;
-        QVector2D texcoord;
-    };
+    using TMDVertex = Model::TriangleList::Vertex;
     
     struct MOVertex
     {
@@ -88,9 +82,9 @@ public:
     };
 
     struct GLMesh {
-        unsigned int numVertex;
+        unsigned int numVertex = 0;
         std::vector<unsigned int> frames;
-        unsigned int VAO;
+        unsigned int VAO = 0; ///< 0 until it's built, since GL never generates that name.
     };
 
     explicit ModelGLView(QWidget* parent = nullptr) : QOpenGLWidget(parent)
@@ -124,7 +118,7 @@ public:
             }
             meshes.clear();
 
-            if(model->animFrames.empty())
+            if(model->animations.empty())
             {
                 //Clear Shader
                 glTMDProgram.release();
@@ -184,6 +178,7 @@ private:
     void buildModel();
 
     void BuildMOAnimation();
+    void BuildMOAnimationFrames(size_t animationIndex);
     void DrawMOAnimation();
 
     void BuildTMDModel();
@@ -50,10 +50,7 @@ void TextureDBViewer::on_exportAllBtn_clicked()
     auto dir = QFileDialog::getExistingDirectory(this, "Export all textures", QDir::currentPath());
     if (dir.isEmpty()) return;
 
-    for (size_t i = 0; i < reinterpret_cast<TextureDB*>(handler.get())->getTextureCount(); i++)
-        reinterpret_cast<TextureDB*>(handler.get())
-            ->getTexture(i)
-            .image.save(dir + QDir::separator() + "Texture" + QString::number(i) + ".png", "png");
+    reinterpret_cast<TextureDB*>(handler.get())->exportAll(dir);
 }
 
 void TextureDBViewer::on_texList_activated(const QModelIndex &index)
@@ -11,7 +11,7 @@ namespace PS1
 class SEQ
 {
 public:
-    SEQ(QByteArray& data, uint32_t offset = 0) : m_data(data), m_dataOffset(offset)
+    SEQ(const QByteArray& data, uint32_t offset = 0) : m_data(data), m_dataOffset(offset)
     {
         fsmt_assert(signature() == 0x53455170, "PSX::SEQ::SEQ: Signature mismatch!");
     }
@@ -19,10 +19,10 @@ public:
     uint32_t fileSize() const
     {
     }
-    uint32_t& signature() const { return Utilities::as<uint32_t>(m_data, m_dataOffset); }
+    const uint32_t& signature() const { return Utilities::as<uint32_t>(m_data, m_dataOffset); }
     
 private:
-    QByteArray& m_data;
+    const QByteArray& m_data;
     uint32_t m_dataOffset;
 };
 
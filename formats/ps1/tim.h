@@ -38,7 +38,7 @@ public:
         Mixed = 4
     };
 
-    TIM(QByteArray& data, uint32_t offset = 0) : m_data(data), m_dataOffset(offset)
+    TIM(const QByteArray& data, uint32_t offset = 0) : m_data(data), m_dataOffset(offset)
     {
         fsmt_assert(signature() == 0x10, "PSX::TIM::TIM: Signature mismatch!");
     }
@@ -65,12 +65,12 @@ public:
 
         return size;
     }
-    uint32_t& flag() const { return Utilities::as<uint32_t>(m_data, m_dataOffset + 4); }
+    const uint32_t& flag() const { return Utilities::as<uint32_t>(m_data, m_dataOffset + 4); }
     PixelMode pixelMode() const { return static_cast<PixelMode>(flag() & 7u); }
-    uint32_t& signature() const { return Utilities::as<uint32_t>(m_data, m_dataOffset); }
+    const uint32_t& signature() const { return Utilities::as<uint32_t>(m_data, m_dataOffset); }
 
 private:
-    QByteArray& m_data;
+    const QByteArray& m_data;
     uint32_t m_dataOffset;
 };
 
@@ -5,6 +5,7 @@
 #include "types/ps1/libgte.h"
 #include "utilities.h"
 #include <QByteArray>
+#include <algorithm>
 
 namespace PS1
 {
@@ -12,15 +13,20 @@ namespace PS1
 class TMD
 {
 public:
+    /*!
+     * \brief View of an object's arrays, pointing straight into the TMD's data.
+     * Arrays that don't fit in the data are nullptr.
+     */
     struct TMDObject
     {
-        PS1::SVECTOR* vertices;
-        PS1::SVECTOR* normals;
-        void* primitives;
+        const PS1::SVECTOR* vertices;
+        const PS1::SVECTOR* normals;
+        const void* primitives;
         uint32_t vertexCount;
         uint32_t normalCount;
         uint32_t primitiveCount;
         int32_t scale;
+        uint32_t primitiveBytes; ///< Bytes from the primitives to the end of the data.
     };
     
     /*!
@@ -34,51 +40,96 @@ public:
      */
     enum class PrimitiveMode;
 
-    TMD(QByteArray& data, uint32_t offset = 0) : m_data(data), m_dataOffset(offset)
+    TMD(const QByteArray& data, uint32_t offset = 0) : m_data(data), m_dataOffset(offset)
     {
-        // Ensure this has the TMD signature.
-        fsmt_assert(signature() == 0x41, "PSX::TMD::TMD: Signature mismatch!");
-        // And that we have offsets and not real addresses.
-        fsmt_assert(flags() == 0, "PSX::TMD::TMD: TMD has real addresses!");
+        fsmt_assert(isValid(), "PSX::TMD::TMD: Not a TMD, or its object table is cut off!");
+        // Ensure this has the TMD signature, or the RTMD one.
+        fsmt_assert(signature() == 0x41 || signature() == 0, "PSX::TMD::TMD: Signature mismatch!");
+        // And that we have offsets and not real addresses. RTMDs use flags 0x10 and 0x12.
+        fsmt_assert(flags() == 0 || flags() == 0x10 || flags() == 0x12,
+                    "PSX::TMD::TMD: TMD has real addresses!");
     }
-    
+
+    /*!
+     * \brief Checks whether a TMD's header and object table fit in the data.
+     */
+    static bool isValid(const QByteArray& data, uint32_t offset = 0)
+    {
+        if (offset > static_cast<uint32_t>(data.size())) return false;
+        const auto size = static_cast<uint32_t>(data.size()) - offset;
+        if (size < 12u) return false;
+        const auto count = Utilities::as<uint32_t>(data, offset + 8u);
+        return count <= (size - 12u) / sizeof(NativeObjectInfo);
+    }
+
+    bool isValid() const { return isValid(m_data, m_dataOffset); }
+
+    /*!
+     * \brief Size of the TMD: up to the end of whichever object array ends last.
+     * Arrays that go past the end of the data are left out.
+     */
     uint32_t fileSize() const
     {
-        auto& lastObject = Utilities::as<NativeObjectInfo>(m_data,
-                                                           m_dataOffset + 12u
-                                                           + (objectCount() * sizeof(NativeObjectInfo)));
-        
-        uint32_t curOffset = m_dataOffset + lastObject.primitiveOffset;
-        
-        for (uint32_t curPrim = 0; curPrim < lastObject.primitiveCount; curPrim++)
+        const auto count = objectCount();
+        uint32_t end = 12u + count * static_cast<uint32_t>(sizeof(NativeObjectInfo));
+
+        for (uint32_t curObj = 0; curObj < count; curObj++)
         {
-            uint16_t ilen = Utilities::as<uint8_t>(m_data, curOffset + 1u);
-            curOffset += 4 + (ilen * 4);
+            const auto& obj = nativeObject(curObj);
+            if (fits(obj.vertexOffset, obj.vertexCount, sizeof(SVECTOR)))
+                end = std::max(end, 12u + obj.vertexOffset + obj.vertexCount * 8u);
+            if (fits(obj.normalOffset, obj.normalCount, sizeof(SVECTOR)))
+                end = std::max(end, 12u + obj.normalOffset + obj.normalCount * 8u);
+
+            // Primitives are packets of a 4 byte header and ilen words. Offsets are checked
+            // against the space left, like fits() does, since adding to them could wrap around.
+            if (obj.primitiveOffset > size() - 12u) continue;
+            uint32_t curOffset = 12u + obj.primitiveOffset;
+            for (uint32_t curPrim = 0; curPrim < obj.primitiveCount; curPrim++)
+            {
+                if (curOffset > size() || size() - curOffset < 4u) break;
+                curOffset += 4u + Utilities::as<uint8_t>(m_data, m_dataOffset + curOffset + 1u) * 4u;
+            }
+            end = std::max(end, std::min(curOffset, size()));
         }
-        
-        return curOffset;
+
+        return end;
     }
-    uint32_t& flags() const { return Utilities::as<uint32_t>(m_data, m_dataOffset + 4u); }
-    TMDObject object(uint32_t index)
+    const uint32_t& flags() const { return Utilities::as<uint32_t>(m_data, m_dataOffset + 4u); }
+    /*!
+     * \brief Gets a view of an object. Nothing is copied or decoded.
+     * \param index Object index, which must be less than objectCount().
+     */
+    TMDObject object(uint32_t index) const
     {
-        auto& nativeObj = Utilities::as<NativeObjectInfo>(m_data,
-                                                           m_dataOffset + 12u + (index * sizeof(NativeObjectInfo)));
-        
-        uint8_t* basePtr = reinterpret_cast<uint8_t*>(m_data.data()) + m_dataOffset + 12u;
-         
+        const auto& nativeObj = nativeObject(index);
+
+        const auto* basePtr = reinterpret_cast<const uint8_t*>(m_data.constData()) + m_dataOffset
+                              + 12u;
+        const auto arraySize = size() - 12u;
+
         return
         {
-            reinterpret_cast<PS1::SVECTOR*>(basePtr + nativeObj.vertexOffset),
-            reinterpret_cast<PS1::SVECTOR*>(basePtr + nativeObj.normalOffset),
-            basePtr + nativeObj.primitiveOffset,
+            fits(nativeObj.vertexOffset, nativeObj.vertexCount, sizeof(SVECTOR))
+                ? reinterpret_cast<const PS1::SVECTOR*>(basePtr + nativeObj.vertexOffset)
+                : nullptr,
+            fits(nativeObj.normalOffset, nativeObj.normalCount, sizeof(SVECTOR))
+                ? reinterpret_cast<const PS1::SVECTOR*>(basePtr + nativeObj.normalOffset)
+                : nullptr,
+            nativeObj.primitiveOffset <= arraySize ? basePtr + nativeObj.primitiveOffset : nullptr,
             nativeObj.vertexCount,
             nativeObj.normalCount,
             nativeObj.primitiveCount,
-            nativeObj.scale
+            nativeObj.scale,
+            nativeObj.primitiveOffset <= arraySize ? arraySize - nativeObj.primitiveOffset : 0
         };
     }
-    uint32_t& objectCount() const { return Utilities::as<uint32_t>(m_data, m_dataOffset + 8); }
-    uint32_t& signature() const { return Utilities::as<uint32_t>(m_data, m_dataOffset); }
+    const uint32_t& objectCount() const { return Utilities::as<uint32_t>(m_data, m_dataOffset + 8); }
+    const uint32_t& signature() const { return Utilities::as<uint32_t>(m_data, m_dataOffset); }
+    /*!
+     * \brief Size of the data from the start of the TMD.
+     */
+    uint32_t size() const { return static_cast<uint32_t>(m_data.size()) - m_dataOffset; }
 
 private:
     /*!
@@ -94,8 +145,24 @@ private:
         uint32_t primitiveCount;
         int32_t scale;
     };
-    
-    QByteArray& m_data;
+
+    const NativeObjectInfo& nativeObject(uint32_t index) const
+    {
+        return Utilities::as<NativeObjectInfo>(m_data,
+                                               m_dataOffset + 12u
+                                                   + (index * sizeof(NativeObjectInfo)));
+    }
+
+    /*!
+     * \brief Checks whether an array at an offset from the object table fits in the data.
+     */
+    bool fits(uint32_t offset, uint32_t count, uint32_t elementSize) const
+    {
+        const auto arraySize = size() - 12u;
+        return offset <= arraySize && count <= (arraySize - offset) / elementSize;
+    }
+
+    const QByteArray& m_data;
     uint32_t m_dataOffset;
 };
 
@@ -1,3 +1,4 @@
+#include "core/batchmode.h"
 #include "core/icons.h"
 #include "mainwindow.h"
 
@@ -5,6 +6,13 @@
 
 int main(int argc, char *argv[])
 {
+    // Batch jobs run on build servers without a display, so they never create the GUI.
+    if (argc > 1 && BatchMode::isCommand(QString::fromLocal8Bit(argv[1])))
+    {
+        QCoreApplication a(argc, argv);
+        return BatchMode::run(a.arguments());
+    }
+
     QApplication a(argc, argv);
     Icons::init();
     a.setWindowIcon(QIcon("qrc:/KFModTool.png"));
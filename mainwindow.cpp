@@ -11,26 +11,100 @@
 #include "models/kf2/kf2_soundeffectparamstablemodel.h"
 #include "models/kf2/kf2_weaponparamstablemodel.h"
 #include <QFileDialog>
+#include <QTextStream>
 #include <iostream>
 #include <memory>
 
 void MainWindow::on_actionLoad_files_triggered()
+{
+    loadGame({});
+}
+
+void MainWindow::on_actionLoad_files_with_custom_file_list_triggered()
+{
+    auto fileList = QFileDialog::getOpenFileName(this,
+                                                 QStringLiteral("Select the file list to use."),
+                                                 QDir::homePath(),
+                                                 QStringLiteral("File lists (*.csv)"));
+
+    if (fileList.isEmpty()) return;
+
+    loadGame(fileList);
+}
+
+void MainWindow::on_actionLoad_disc_image_triggered()
+{
+    auto image = QFileDialog::getOpenFileName(this,
+                                              QStringLiteral("Select your game's disc image."),
+                                              QDir::homePath(),
+                                              QStringLiteral("Disc images (*.cue *.bin *.iso)"));
+
+    if (image.isEmpty()) return;
+
+    closeAllTabs();
+
+    core.setCustomFileList({});
+    core.loadFromImage(image);
+
+    dynamic_cast<FileListModel*>(ui->filesTree->model())->update();
+}
+
+void MainWindow::loadGame(const QString& customFileList)
 {
     auto directory = QFileDialog::getExistingDirectory(
         this, QStringLiteral("Select the root folder of your game's CD."), QDir::homePath());
 
     if (directory.isEmpty()) return;
 
-    // Close all tabs
-    for (int tab = ui->editorTabs->count() - 1; tab >= 0; tab--) ui->editorTabs->removeTab(tab);
-    
+    closeAllTabs();
+
+    core.setCustomFileList(customFileList);
     core.loadFrom(directory);
 
     dynamic_cast<FileListModel*>(ui->filesTree->model())->update();
 }
 
+void MainWindow::closeAllTabs()
+{
+    // The editors point into the files that are about to be unloaded, so they go away with their
+    // tabs, and saving can't reach them anymore.
+    for (int tab = ui->editorTabs->count() - 1; tab >= 0; tab--)
+    {
+        auto* editor = ui->editorTabs->widget(tab);
+        ui->editorTabs->removeTab(tab);
+        editor->deleteLater();
+    }
+    openTabs.clear();
+}
+
 void MainWindow::on_actionSave_changes_triggered()
 {
+    if (core.loadedFromImage())
+    {
+        auto answer = QMessageBox::question(
+            this,
+            QStringLiteral("Patch the disc image?"),
+            QStringLiteral("Your game was loaded from a disc image. Do you want to write your "
+                           "changes straight into it? Choose No to save the files to a directory "
+                           "instead."),
+            QMessageBox::Yes | QMessageBox::No | QMessageBox::Cancel);
+
+        if (answer == QMessageBox::Cancel) return;
+        if (answer == QMessageBox::Yes)
+        {
+            for (auto& [file, editor] : openTabs)
+                editor->saveChanges();
+
+            core.saveToImage();
+
+            QMessageBox::information(this,
+                                     QStringLiteral("Changes saved successfully!"),
+                                     QStringLiteral("Your changes have been written to the disc "
+                                                    "image!"));
+            return;
+        }
+    }
+
     auto dirPath = QFileDialog::getExistingDirectory(this,
                                                      QStringLiteral(
                                                          "Select where to save the changed files"),
@@ -49,6 +123,10 @@ void MainWindow::on_actionSave_changes_triggered()
         if (answer != QMessageBox::Yes) return;
     }
 
+    // Editors only mark their files as changed when saving, so they have to save first.
+    for (auto& [file, editor] : openTabs)
+        editor->saveChanges();
+
     core.saveTo(dirPath);
 
     QMessageBox::information(this,
@@ -56,6 +134,40 @@ void MainWindow::on_actionSave_changes_triggered()
                              QStringLiteral("Your changes have been saved!"));
 }
 
+void MainWindow::on_actionReport_duplicate_files_triggered()
+{
+    const auto groups = core.duplicateGroups();
+    if (groups.empty())
+    {
+        QMessageBox::information(this,
+                                 QStringLiteral("No duplicate files"),
+                                 QStringLiteral("No files with the same contents were found."));
+        return;
+    }
+
+    auto reportPath = QFileDialog::getSaveFileName(this,
+                                                   QStringLiteral("Save the duplicate file report"),
+                                                   QDir::homePath(),
+                                                   QStringLiteral("Text files (*.txt)"));
+    if (reportPath.isEmpty()) return;
+
+    QFile report(reportPath);
+    if (!report.open(QIODevice::WriteOnly | QIODevice::Text))
+    {
+        KFMTError::error(QStringLiteral("Couldn't open %1 for writing.").arg(reportPath));
+        return;
+    }
+
+    QTextStream reportStream(&report);
+    for (const auto& group : groups)
+    {
+        reportStream << group.size() << " copies of " << group.front()->m_data.size()
+                     << " bytes:\n";
+        for (const auto* file : group)
+            reportStream << "    " << file->path() << '\n';
+    }
+}
+
 void MainWindow::on_filesTree_doubleClicked(const QModelIndex& index)
 {
     auto* file = reinterpret_cast<KFMTFile*>(index.internalPointer());
@@ -48,6 +48,10 @@ private slots:
 
     void on_actionLoad_files_triggered();
 
+    void on_actionLoad_files_with_custom_file_list_triggered();
+
+    void on_actionLoad_disc_image_triggered();
+
     void on_editorTabs_tabCloseRequested(int index)
     {
         auto* tab = ui->editorTabs->widget(index);
@@ -63,11 +67,24 @@ private slots:
 
     void on_actionSave_changes_triggered();
 
+    void on_actionReport_duplicate_files_triggered();
+
     void on_actionExit_triggered() { close(); }
 
     void on_filesTree_doubleClicked(const QModelIndex& index);
 
 private:
+    /*!
+     * \brief Asks for a game folder and loads it, using the given custom file list if any.
+     * \param customFileList Path to a CSV file list, or an empty string for the built-in ones.
+     */
+    void loadGame(const QString& customFileList);
+
+    /*!
+     * \brief Closes every editor tab, before the files they edit are unloaded.
+     */
+    void closeAllTabs();
+
     Ui::MainWindow* ui;
 
     std::unordered_map<KFMTFile*, KFMTEditor*> openTabs;
@@ -2,6 +2,7 @@
 #include "core/icons.h"
 #include "core/kfmtcore.h"
 #include <QAbstractItemView>
+#include <QColor>
 #include <QIcon>
 #include <iostream>
 
@@ -38,13 +39,20 @@ QModelIndex FileListModel::parent(const QModelIndex &index) const
     // If this file is in the root, there's no parent.
     if (parent == &core.files) return {};
      
-    // Otherwise, get grandparent to find row and build index
-    KFMTFile* grandparent = parent->parent();
-    fsmt_assert(grandparent != nullptr, "FileListModel::parent: File has null grandparent!");
-    for (uint32_t c = 0; c < grandparent->childCount(); c++)
-        if (parent == (*grandparent)[c]) return createIndex(c, 0, parent);
-    
-    return {};
+    // Otherwise, the parent knows its own row.
+    return createIndex(static_cast<int>(parent->indexInParent()), 0, parent);
+}
+
+bool FileListModel::hasChildren(const QModelIndex& parent) const
+{
+    if (!parent.isValid()) return core.files.childCount() > 0;
+
+    // The view asks this for every visible row to decide whether to draw an expand arrow. Asking
+    // rowCount would split every visible container, so we don't until the user expands one.
+    auto* file = reinterpret_cast<KFMTFile*>(parent.internalPointer());
+    if (!file->isExpanded()) return true;
+
+    return file->childCount() > 0;
 }
 
 int FileListModel::rowCount(const QModelIndex &parent) const
@@ -69,6 +77,14 @@ QVariant FileListModel::data(const QModelIndex &index, int role) const
     if (role == Qt::DisplayRole)
         return file->prettyName();
 
+    if (file->hasBadChecksum())
+    {
+        if (role == Qt::ForegroundRole) return QColor(Qt::red);
+        if (role == Qt::ToolTipRole)
+            return QStringLiteral("This file's checksum doesn't match its data. Saving changes to "
+                                  "it fixes the checksum.");
+    }
+
     if (role != Qt::DecorationRole) return {};
     
     switch (file->dataType())
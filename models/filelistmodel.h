@@ -14,13 +14,17 @@ class FileListModel : public QAbstractItemModel
 public:
     explicit inline FileListModel(QObject* parent = nullptr) : QAbstractItemModel(parent)
     {
-        containerContextMenu = new QMenu("Container context menu", dynamic_cast<QWidget*>(parent));
+        // Without a view there's nothing to show a context menu on. The benchmarks make one like
+        // that, and there may not even be a QApplication then.
+        auto* view = dynamic_cast<QWidget*>(parent);
+        if (view == nullptr) return;
+
+        containerContextMenu = new QMenu("Container context menu", view);
         extractContainerAction = new QAction("Extract files...", containerContextMenu);
         // This bit of code sets up the context menu
         containerContextMenu->addAction(extractContainerAction);
-        dynamic_cast<QWidget*>(parent)->setContextMenuPolicy(
-            Qt::ContextMenuPolicy::CustomContextMenu);
-        connect(dynamic_cast<QWidget*>(parent),
+        view->setContextMenuPolicy(Qt::ContextMenuPolicy::CustomContextMenu);
+        connect(view,
                 &QWidget::customContextMenuRequested,
                 this,
                 &FileListModel::contextMenu);
@@ -35,6 +39,7 @@ public:
                       const QModelIndex &parent = QModelIndex()) const override;
     QModelIndex parent(const QModelIndex &index) const override;
     
+    bool hasChildren(const QModelIndex& parent = QModelIndex()) const override;
     int rowCount(const QModelIndex &parent = QModelIndex()) const override;
     int columnCount(const QModelIndex& parent = QModelIndex()) const override;
 
@@ -49,8 +54,8 @@ public slots:
     void contextMenu(const QPoint& pos);
 
 private:
-    QMenu* containerContextMenu;
-    QAction* extractContainerAction;
+    QMenu* containerContextMenu = nullptr;
+    QAction* extractContainerAction = nullptr;
     KFMTFile* contextMenuFile = nullptr;
 
 private slots:
@@ -64,9 +69,8 @@ private slots:
 
         if (dir.isEmpty()) return;
 
-        contextMenuFile->extractTo(dir);
-
-        KFMTError::warning(QStringLiteral("Extraction complete!"));
+        if (contextMenuFile->extractTo(dir))
+            KFMTError::warning(QStringLiteral("Extraction complete!"));
     }
 };
 
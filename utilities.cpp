@@ -1,6 +1,270 @@
 #include "utilities.h"
+#include <QtEndian>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define FSMT_CHECKSUM_SSE2
+#endif
 
 namespace Utilities
 {
 const QString valNameStr = QStringLiteral(u"%1 (%2)");
+
+namespace
+{
+/*!
+ * \brief Bounds-checked view of a file's header for detectFormat.
+ */
+class HeaderReader
+{
+public:
+    explicit HeaderReader(const QByteArray& file)
+        : m_bytes(reinterpret_cast<const uint8_t*>(file.constData())),
+          m_size(static_cast<uint32_t>(file.size()))
+    {}
+
+    bool has(uint32_t offset, uint32_t size) const
+    {
+        return offset <= m_size && size <= m_size - offset;
+    }
+
+    uint8_t byte(uint32_t offset) const { return m_bytes[offset]; }
+
+    uint32_t word(uint32_t offset) const
+    {
+        uint32_t value;
+        std::memcpy(&value, m_bytes + offset, sizeof(value));
+        return value;
+    }
+
+    bool equals(uint32_t offset, const char* bytes, uint32_t size) const
+    {
+        return has(offset, size) && std::memcmp(m_bytes + offset, bytes, size) == 0;
+    }
+
+    bool equals(uint32_t offset1, uint32_t offset2, uint32_t size) const
+    {
+        return std::memcmp(m_bytes + offset1, m_bytes + offset2, size) == 0;
+    }
+
+    uint32_t size() const { return m_size; }
+
+private:
+    const uint8_t* m_bytes;
+    uint32_t m_size;
+};
+} // namespace
+
+/*!
+ * \brief The MIM part of fileIsMIM, for a file that's already known to be a MO file.
+ */
+static bool isMIM(const HeaderReader& file)
+{
+    if (!file.has(0x04, 4)) return false;
+    const auto animCount = file.word(0x04);
+    if (animCount == 0) return true;
+
+    if (animCount == 1)
+    {
+        if (!file.has(0x0C, 4)) return false;
+        const auto morphTargetTableOffset = file.word(0x0C);
+        if (!file.has(morphTargetTableOffset, 4)) return false;
+        const auto morphTarget1Offset = file.word(morphTargetTableOffset);
+        const auto tmdOffset = file.word(0x08);
+        if (!file.has(morphTarget1Offset + 8, 4) || !file.has(tmdOffset + 16, 4)) return false;
+
+        return file.word(morphTarget1Offset + 8) == file.word(tmdOffset + 16);
+    }
+
+    if (!file.has(0x14, 4)) return false;
+    const auto firstAnimOffset = file.word(0x14);
+    if (!file.has(firstAnimOffset, 4)) return false;
+
+    return file.word(firstAnimOffset) > 0xFFFF;
+}
+
+static uint32_t sumWordsScalar(const uint8_t* data, size_t words)
+{
+    uint32_t sum = 0;
+    for (size_t word = 0; word < words; word++)
+        sum += qFromLittleEndian<quint32>(data + word * 4);
+    return sum;
+}
+
+constexpr uint64_t xxPrime1 = 0x9E3779B185EBCA87ULL;
+constexpr uint64_t xxPrime2 = 0xC2B2AE3D27D4EB4FULL;
+constexpr uint64_t xxPrime3 = 0x165667B19E3779F9ULL;
+constexpr uint64_t xxPrime4 = 0x85EBCA77C2B2AE63ULL;
+constexpr uint64_t xxPrime5 = 0x27D4EB2F165667C5ULL;
+
+static uint64_t rotateLeft(uint64_t value, int bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+static uint64_t xxRound(uint64_t accumulator, uint64_t input)
+{
+    accumulator += input * xxPrime2;
+    return rotateLeft(accumulator, 31) * xxPrime1;
+}
+
+static uint64_t xxMergeRound(uint64_t accumulator, uint64_t value)
+{
+    accumulator ^= xxRound(0, value);
+    return accumulator * xxPrime1 + xxPrime4;
+}
+
+#ifdef FSMT_CHECKSUM_SSE2
+/*!
+ * \brief Sums words 16 at a time, which is memory bound on anything with SSE2.
+ * Wrapping additions are associative, so the order the lanes are added in doesn't matter.
+ */
+static uint32_t sumWords(const uint8_t* data, size_t words)
+{
+    // Separate accumulators so consecutive adds don't wait for each other.
+    __m128i sum0 = _mm_setzero_si128();
+    __m128i sum1 = _mm_setzero_si128();
+    __m128i sum2 = _mm_setzero_si128();
+    __m128i sum3 = _mm_setzero_si128();
+
+    size_t word = 0;
+    for (; word + 16 <= words; word += 16)
+    {
+        const auto* block = reinterpret_cast<const __m128i*>(data + word * 4);
+        sum0 = _mm_add_epi32(sum0, _mm_loadu_si128(block));
+        sum1 = _mm_add_epi32(sum1, _mm_loadu_si128(block + 1));
+        sum2 = _mm_add_epi32(sum2, _mm_loadu_si128(block + 2));
+        sum3 = _mm_add_epi32(sum3, _mm_loadu_si128(block + 3));
+    }
+    for (; word + 4 <= words; word += 4)
+        sum0 = _mm_add_epi32(sum0,
+                             _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + word * 4)));
+
+    const auto sum = _mm_add_epi32(_mm_add_epi32(sum0, sum1), _mm_add_epi32(sum2, sum3));
+    alignas(16) uint32_t lanes[4];
+    _mm_store_si128(reinterpret_cast<__m128i*>(lanes), sum);
+
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3]
+           + sumWordsScalar(data + word * 4, words - word);
+}
+#else
+static uint32_t sumWords(const uint8_t* data, size_t words)
+{
+    return sumWordsScalar(data, words);
+}
+#endif
+
+DetectedFormat detectFormat(const QByteArray& file)
+{
+    const HeaderReader header(file);
+    if (!header.has(0, 4)) return DetectedFormat::Unknown;
+
+    // Same order as the fileIs* chain KFMTFile::extension() used to run.
+    const auto first = header.word(0);
+    if (first == 0x582D5350 && header.equals(0, "PS-X EXE", 8)) return DetectedFormat::PSXEXE;
+    if (first == 0x41) return DetectedFormat::TMD;
+    if (first == 0x10 && header.has(4, 4) && header.byte(4) > 0 && header.byte(4) <= 15
+        && header.equals(5, "\0\0\0", 3))
+        return DetectedFormat::TIM;
+
+    if (header.has(0, 16) && header.equals(0, 8, 8) && !header.equals(0, 4, 4))
+        return DetectedFormat::RTIM;
+
+    if (header.has(0, 8) && first == 0 && (header.word(4) == 0x12 || header.word(4) == 0x10))
+        return DetectedFormat::RTMD;
+
+    if (header.has(0, 12))
+    {
+        // MO files (and MIM files, which are a kind of MO file) point to a TMD at offset 8.
+        const auto tmdOffset = header.word(8);
+        if (tmdOffset < header.size() && header.byte(tmdOffset) == 0x41)
+            return isMIM(header) ? DetectedFormat::MIM : DetectedFormat::MO;
+    }
+
+    if (first == 0x0000FA00) return DetectedFormat::MAP1;
+    if (first == 0x000032C0) return DetectedFormat::MAP2;
+
+    if (header.has(0, 0x20) && header.byte(0x03) == 0x80 && header.byte(0x07) == header.byte(0x0b)
+        && header.byte(0x0b) == header.byte(0x0f) && header.byte(0x13) == header.byte(0x17)
+        && header.byte(0x17) == header.byte(0x1b) && header.byte(0x1b) == header.byte(0x1f))
+        return DetectedFormat::MAP3;
+
+    if (header.equals(4, "\x40\x10\xFF\0\0\0", 6)
+        && header.equals(20, "\0\0\0\0\0\0\0\0\x40\x10\xFF\0\0\0", 14))
+        return DetectedFormat::KF2GameDB;
+
+    // extension() didn't look for sound files. KFMTFile::loadMIX did, after TIMs, TMDs and MIMs.
+    if (first == 0x53455170) return DetectedFormat::SEQ; // "pQES"
+    if (first == 0x56414270) return DetectedFormat::VH;  // "pBAV"
+    if (header.equals(0, "\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0", 16)) return DetectedFormat::VB;
+
+    return DetectedFormat::Unknown;
+}
+
+uint64_t contentHash(const QByteArray& file)
+{
+    const auto* data = reinterpret_cast<const uint8_t*>(file.constData());
+    const auto size = static_cast<size_t>(file.size());
+    const auto* const end = data + size;
+    uint64_t hash;
+
+    if (size >= 32)
+    {
+        uint64_t lane1 = xxPrime1 + xxPrime2;
+        uint64_t lane2 = xxPrime2;
+        uint64_t lane3 = 0;
+        uint64_t lane4 = 0 - xxPrime1;
+        for (; data + 32 <= end; data += 32)
+        {
+            lane1 = xxRound(lane1, qFromLittleEndian<quint64>(data));
+            lane2 = xxRound(lane2, qFromLittleEndian<quint64>(data + 8));
+            lane3 = xxRound(lane3, qFromLittleEndian<quint64>(data + 16));
+            lane4 = xxRound(lane4, qFromLittleEndian<quint64>(data + 24));
+        }
+
+        hash = rotateLeft(lane1, 1) + rotateLeft(lane2, 7) + rotateLeft(lane3, 12)
+               + rotateLeft(lane4, 18);
+        hash = xxMergeRound(hash, lane1);
+        hash = xxMergeRound(hash, lane2);
+        hash = xxMergeRound(hash, lane3);
+        hash = xxMergeRound(hash, lane4);
+    }
+    else
+        hash = xxPrime5;
+
+    hash += size;
+
+    for (; data + 8 <= end; data += 8)
+        hash = rotateLeft(hash ^ xxRound(0, qFromLittleEndian<quint64>(data)), 27) * xxPrime1
+               + xxPrime4;
+    if (data + 4 <= end)
+    {
+        hash ^= qFromLittleEndian<quint32>(data) * xxPrime1;
+        hash = rotateLeft(hash, 23) * xxPrime2 + xxPrime3;
+        data += 4;
+    }
+    for (; data < end; data++)
+        hash = rotateLeft(hash ^ (*data * xxPrime5), 11) * xxPrime1;
+
+    hash ^= hash >> 33;
+    hash *= xxPrime2;
+    hash ^= hash >> 29;
+    hash *= xxPrime3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+uint32_t tChecksum(const uint8_t* data, size_t size)
+{
+    const auto words = size / 4;
+    if (words == 0) return 0x12345678;
+    return 0x12345678 + sumWords(data, words - 1);
+}
+
+bool hasValidTChecksum(const uint8_t* data, size_t size)
+{
+    const auto words = size / 4;
+    if (words == 0) return true;
+    return qFromLittleEndian<quint32>(data + (words - 1) * 4) == tChecksum(data, size);
+}
 } // namespace Utilities
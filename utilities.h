@@ -310,6 +310,71 @@ inline bool fileIsVH(const QByteArray& file)
     return file.left(4).compare(QByteArray::fromHex("70424156")) == 0;
 }
 
+/*!
+ * \brief File formats that can be told apart by looking at a file's data.
+ */
+enum class DetectedFormat : uint8_t
+{
+    Unknown,
+    KF2GameDB,
+    MAP1,
+    MAP2,
+    MAP3,
+    MIM,
+    MO,
+    PSXEXE,
+    RTIM,
+    RTMD,
+    SEQ,
+    TIM,
+    TMD,
+    VB,
+    VH
+};
+
+/*!
+ * \brief Detects a file's format in one pass over its header.
+ * This runs the same checks as the fileIs* functions, in the order KFMTFile::extension() used to
+ * run them, but reads the header in place instead of copying the data for every check, and never
+ * reads past the end of the file. Sound files, which extension() didn't look for, are checked last.
+ * \param file File to check.
+ * \return The detected format, or DetectedFormat::Unknown.
+ */
+DetectedFormat detectFormat(const QByteArray& file);
+
+/*!
+ * \brief Calculates the checksum of a T file subfile.
+ * That's the sum of every 32-bit word but the last one (where it's stored), starting from
+ * 0x12345678. Bytes past the last whole word are ignored.
+ * \param data Start of the subfile.
+ * \param size Size of the subfile in bytes.
+ */
+uint32_t tChecksum(const uint8_t* data, size_t size);
+
+inline uint32_t tChecksum(const QByteArray& file)
+{
+    return tChecksum(reinterpret_cast<const uint8_t*>(file.constData()),
+                     static_cast<size_t>(file.size()));
+}
+
+/*!
+ * \brief Checks whether a T file subfile ends with the right checksum.
+ * Files smaller than a word have nowhere to store one, so they're always valid.
+ */
+bool hasValidTChecksum(const uint8_t* data, size_t size);
+
+inline bool hasValidTChecksum(const QByteArray& file)
+{
+    return hasValidTChecksum(reinterpret_cast<const uint8_t*>(file.constData()),
+                             static_cast<size_t>(file.size()));
+}
+
+/*!
+ * \brief Hashes a file's contents with XXH64, to tell files apart without comparing them.
+ * It isn't cryptographic, so files that hash the same still have to be compared to be sure.
+ */
+uint64_t contentHash(const QByteArray& file);
+
 extern const QString valNameStr;
 inline QString valueAndName_(uint32_t val, const QString name)
 {